@@ -0,0 +1,206 @@
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "split_basic_stream.h"
+
+split::PosixBackend::PosixBackend(PosixBackend&& other) noexcept
+    : fd(std::exchange(other.fd, -1)) {}
+
+split::PosixBackend& split::PosixBackend::operator=(PosixBackend&& other) noexcept {
+    if (this != &other) {
+        close();
+        fd = std::exchange(other.fd, -1);
+    }
+    return *this;
+}
+
+bool split::PosixBackend::open(const std::filesystem::path &_Path, bool _Write) {
+    close();
+    int flags = _Write ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDONLY;
+    fd = ::open(_Path.c_str(), flags | O_CLOEXEC, 0644);
+    return fd >= 0;
+}
+
+uint64_t split::PosixBackend::size() const {
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_size);
+}
+
+bool split::PosixBackend::resize(uint64_t _Size) {
+    return fd >= 0 && ::ftruncate(fd, static_cast<off_t>(_Size)) == 0;
+}
+
+void split::PosixBackend::close() {
+    detail::close_fd(fd);
+    fd = -1;
+}
+
+bool split::MmapBackend::open(const std::filesystem::path &_Path, bool _Write) {
+    // Nothing to write through, the mapping is read-only
+    return !_Write && map.map(_Path);
+}
+
+uint64_t split::MmapBackend::read(uint64_t _Off, char* _Str, uint64_t _Count) {
+    if (_Off >= map.size()) {
+        return 0;
+    }
+    uint64_t count = std::min(_Count, map.size() - _Off);
+    std::memcpy(_Str, map.data() + _Off, static_cast<std::size_t>(count));
+    return count;
+}
+
+bool split::FstreamBackend::open(const std::filesystem::path &_Path, bool _Write) {
+    close();
+    std::ios::openmode mode = _Write ? (std::ios::in | std::ios::out | std::ios::trunc) : std::ios::in;
+    stream.open(_Path, mode | std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    std::error_code ec;
+    path = _Path;
+    length = _Write ? 0 : std::filesystem::file_size(_Path, ec);
+    cursor = 0;
+    writing = false;
+    return !ec;
+}
+
+uint64_t split::FstreamBackend::read(uint64_t _Off, char* _Str, uint64_t _Count) {
+    // A filebuf has to be repositioned between writing and reading
+    if (_Off != cursor || writing) {
+        stream.clear();
+        stream.seekg(static_cast<std::streamoff>(_Off), std::ios::beg);
+        writing = false;
+    }
+    stream.read(_Str, static_cast<std::streamsize>(_Count));
+    uint64_t read = static_cast<uint64_t>(stream.gcount());
+    cursor = (read == _Count) ? _Off + read : UINT64_MAX;
+    return read;
+}
+
+uint64_t split::FstreamBackend::write(uint64_t _Off, const char* _Str, uint64_t _Count) {
+    if (_Off != cursor || !writing) {
+        stream.clear();
+        stream.seekp(static_cast<std::streamoff>(_Off), std::ios::beg);
+        writing = true;
+    }
+    if (!stream.write(_Str, static_cast<std::streamsize>(_Count))) {
+        cursor = UINT64_MAX;
+        return 0;
+    }
+    cursor = _Off + _Count;
+    length = std::max(length, cursor);
+    return _Count;
+}
+
+bool split::FstreamBackend::resize(uint64_t _Size) {
+    // Whatever's buffered has to land before the file is cut or grown under the stream
+    if (!flush()) {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::resize_file(path, _Size, ec);
+    if (ec) {
+        return false;
+    }
+    length = _Size;
+    cursor = UINT64_MAX;
+    return true;
+}
+
+bool split::FstreamBackend::flush() {
+    return !stream.is_open() || static_cast<bool>(stream.flush());
+}
+
+void split::FstreamBackend::close() {
+    if (stream.is_open()) {
+        stream.close();
+    }
+    length = 0;
+    cursor = UINT64_MAX;
+}
+
+namespace {
+
+// The files of MemoryBackend, by path
+struct MemoryFiles {
+    std::mutex mutex;
+    std::map<std::filesystem::path, std::shared_ptr<std::vector<char>>> files;
+};
+
+MemoryFiles& memory_files() {
+    static MemoryFiles files;
+    return files;
+}
+
+} // namespace
+
+bool split::MemoryBackend::open(const std::filesystem::path &_Path, bool _Write) {
+    MemoryFiles& memory = memory_files();
+    std::lock_guard<std::mutex> lock(memory.mutex);
+    if (_Write) {
+        data = std::make_shared<std::vector<char>>();
+        memory.files[_Path] = data;
+        return true;
+    }
+    auto it = memory.files.find(_Path);
+    if (it == memory.files.end()) {
+        return false;
+    }
+    data = it->second;
+    return true;
+}
+
+uint64_t split::MemoryBackend::read(uint64_t _Off, char* _Str, uint64_t _Count) {
+    if (!data || _Off >= data->size()) {
+        return 0;
+    }
+    uint64_t count = std::min<uint64_t>(_Count, data->size() - _Off);
+    std::memcpy(_Str, data->data() + _Off, static_cast<std::size_t>(count));
+    return count;
+}
+
+uint64_t split::MemoryBackend::write(uint64_t _Off, const char* _Str, uint64_t _Count) {
+    if (!data) {
+        return 0;
+    }
+    if (_Off + _Count > data->size()) {
+        data->resize(static_cast<std::size_t>(_Off + _Count));
+    }
+    std::memcpy(data->data() + _Off, _Str, static_cast<std::size_t>(_Count));
+    return _Count;
+}
+
+bool split::MemoryBackend::resize(uint64_t _Size) {
+    if (!data) {
+        return false;
+    }
+    data->resize(static_cast<std::size_t>(_Size));
+    return true;
+}
+
+bool split::MemoryBackend::exists(const std::filesystem::path &_Path) {
+    MemoryFiles& memory = memory_files();
+    std::lock_guard<std::mutex> lock(memory.mutex);
+    return memory.files.count(_Path) > 0;
+}
+
+void split::MemoryBackend::remove(const std::filesystem::path &_Path) {
+    MemoryFiles& memory = memory_files();
+    std::lock_guard<std::mutex> lock(memory.mutex);
+    memory.files.erase(_Path);
+}
+
+void split::MemoryBackend::clear() {
+    MemoryFiles& memory = memory_files();
+    std::lock_guard<std::mutex> lock(memory.mutex);
+    memory.files.clear();
+}
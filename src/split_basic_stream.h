@@ -0,0 +1,368 @@
+#ifndef _SPLIT_BASIC_STREAM_H_
+#define _SPLIT_BASIC_STREAM_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "split_file.h"
+
+namespace split {
+
+// Segment size fixed at compile time, finding the file an offset lands in is a division by a constant
+// (a shift for powers of two)
+template <uint64_t Size>
+struct FixedSize {
+    static_assert(Size > 0, "Files need room for at least one byte");
+    static constexpr uint64_t segment_size() { return Size; }
+};
+
+// Segment size chosen at run time, UINT64_MAX keeps everything in one file
+class DynamicSize {
+public:
+    explicit DynamicSize(uint64_t _Size = UINT64_MAX) : size(_Size) {
+        if (_Size == 0) {
+            throw std::invalid_argument("Files need room for at least one byte");
+        }
+    };
+    uint64_t segment_size() const { return size; }
+
+private:
+    uint64_t size;
+};
+
+// Backends are the files behind a basic_split_stream, one object per file, called with positions inside
+// that file only. Each provides:
+//     bool open(const std::filesystem::path &_Path, bool _Write);  // _Write creates or empties it
+//     uint64_t read(uint64_t _Off, char* _Str, uint64_t _Count);     // bytes read, short at the end
+//     uint64_t write(uint64_t _Off, const char* _Str, uint64_t _Count);
+//     uint64_t size() const;
+//     bool resize(uint64_t _Size);                                    // growing leaves zeros
+//     bool flush();
+//     void close();
+// and is movable, closing the file when destroyed.
+
+// Positional reads and writes on a file descriptor
+class PosixBackend {
+public:
+    PosixBackend() {};
+    PosixBackend(PosixBackend&& other) noexcept;
+    PosixBackend& operator=(PosixBackend&& other) noexcept;
+    PosixBackend(const PosixBackend&) = delete;
+    PosixBackend& operator=(const PosixBackend&) = delete;
+    ~PosixBackend() { close(); }
+
+    bool open(const std::filesystem::path &_Path, bool _Write);
+    uint64_t read(uint64_t _Off, char* _Str, uint64_t _Count) { return detail::pread_all(fd, _Str, _Count, _Off); }
+    uint64_t write(uint64_t _Off, const char* _Str, uint64_t _Count) { return detail::pwrite_all(fd, _Str, _Count, _Off); }
+    uint64_t size() const;
+    bool resize(uint64_t _Size);
+    bool flush() { return true; }
+    void close();
+
+private:
+    int fd{-1};
+};
+
+// Read-only memory mapping, reads are a copy out of the page cache
+class MmapBackend {
+public:
+    bool open(const std::filesystem::path &_Path, bool _Write);
+    uint64_t read(uint64_t _Off, char* _Str, uint64_t _Count);
+    uint64_t write(uint64_t, const char*, uint64_t) { return 0; }
+    uint64_t size() const { return map.size(); }
+    bool resize(uint64_t) { return false; }
+    bool flush() { return true; }
+    void close() { map.unmap(); }
+
+private:
+    detail::MappedFile map;
+};
+
+// std::fstream, only seeking when the position or the direction changes
+class FstreamBackend {
+public:
+    bool open(const std::filesystem::path &_Path, bool _Write);
+    uint64_t read(uint64_t _Off, char* _Str, uint64_t _Count);
+    uint64_t write(uint64_t _Off, const char* _Str, uint64_t _Count);
+    uint64_t size() const { return length; }
+    bool resize(uint64_t _Size);
+    bool flush();
+    void close();
+
+private:
+    std::fstream stream;
+    std::filesystem::path path;
+    uint64_t length{0};
+    // Where the stream is, UINT64_MAX when it has to seek before the next transfer
+    uint64_t cursor{UINT64_MAX};
+    bool writing{false};
+};
+
+// Files kept in memory under their path, for tests. Files outlive the streams that wrote them, so a
+// stream can read back what another one wrote, until remove() or clear(). Each file has to be used by
+// one stream at a time, like a file on disk.
+class MemoryBackend {
+public:
+    bool open(const std::filesystem::path &_Path, bool _Write);
+    uint64_t read(uint64_t _Off, char* _Str, uint64_t _Count);
+    uint64_t write(uint64_t _Off, const char* _Str, uint64_t _Count);
+    uint64_t size() const { return data ? data->size() : 0; }
+    bool resize(uint64_t _Size);
+    bool flush() { return true; }
+    void close() { data.reset(); }
+
+    static bool exists(const std::filesystem::path &_Path);
+    static void remove(const std::filesystem::path &_Path);
+    static void clear();
+
+private:
+    std::shared_ptr<std::vector<char>> data;
+};
+
+// A split stream without the standard streams in between: each call goes straight to the backend of
+// the files it touches, with no sentries or virtual calls, and the segment size can be fixed at compile
+// time. Reads and writes share one position. Streams created at a path are written to files named
+// <stem>.1<ext>, <stem>.2<ext>, ... as writes reach them, and can be read back. Streams opened on existing
+// files are read-only. split::ifstream and split::ofstream stay the full featured streams, this has none of
+// their options.
+template <typename Backend, typename SizePolicy = DynamicSize>
+class basic_split_stream {
+public:
+    basic_split_stream() {};
+    basic_split_stream(const std::filesystem::path &_Path, SizePolicy _Sizes = SizePolicy()) { open(_Path, _Sizes); }
+    basic_split_stream(const std::vector<std::filesystem::path> &_Paths, SizePolicy _Sizes = SizePolicy()) { open(_Paths, _Sizes); }
+    basic_split_stream(basic_split_stream&& other) noexcept = default;
+    basic_split_stream& operator=(basic_split_stream&& other) noexcept = default;
+    ~basic_split_stream() { close(); }
+
+    // Creates the first file, throws if it can't be created
+    void open(const std::filesystem::path &_Path, SizePolicy _Sizes = SizePolicy());
+    // Every file but the last must be segment_size() bytes long, with DynamicSize() the size of the first
+    // one is taken. Throws if a file can't be opened or doesn't fit.
+    void open(const std::vector<std::filesystem::path> &_Paths, SizePolicy _Sizes = SizePolicy());
+
+    basic_split_stream& read(char* _Str, std::streamsize _Count);
+    basic_split_stream& write(const char* _Str, std::streamsize _Count);
+    // Without touching the position, returns the number of bytes transferred
+    uint64_t read_at(uint64_t _Off, char* _Str, uint64_t _Count);
+    uint64_t write_at(uint64_t _Off, const char* _Str, uint64_t _Count);
+
+    basic_split_stream& seek(uint64_t _Off, std::ios_base::seekdir _Way);
+    uint64_t tell() const { return position; }
+    uint64_t gcount() const { return last_gcount; }
+    uint64_t size() const { return total_size; }
+    uint64_t segment_size() const { return sizes.segment_size(); }
+    const std::vector<std::filesystem::path>& paths() const { return segment_paths; }
+
+    bool is_open() const { return !segments.empty(); }
+    bool eof() const { return end_of_file; }
+    bool fail() const { return failed; }
+    bool good() const { return !failed && !end_of_file; }
+    void clear() { failed = false; end_of_file = false; }
+    basic_split_stream& flush();
+    void close();
+
+private:
+    unsigned int segment_of(uint64_t _Off) const { return static_cast<unsigned int>(_Off / sizes.segment_size()); }
+    bool extend(unsigned int _Last);
+
+    SizePolicy sizes;
+    std::vector<Backend> segments;
+    std::vector<std::filesystem::path> segment_paths;
+    std::filesystem::path parent_path;
+    std::string file_stem;
+    std::string file_ext;
+    uint64_t position{0};
+    uint64_t total_size{0};
+    uint64_t last_gcount{0};
+    bool writable{false};
+    bool end_of_file{false};
+    bool failed{false};
+};
+
+template <typename Backend, typename SizePolicy>
+void basic_split_stream<Backend, SizePolicy>::open(const std::filesystem::path &_Path, SizePolicy _Sizes) {
+    close();
+    sizes = _Sizes;
+    parent_path = _Path.parent_path();
+    file_stem = _Path.stem().string();
+    file_ext = _Path.extension().string();
+    segment_paths.clear();
+    position = 0;
+    total_size = 0;
+    writable = true;
+    clear();
+    if (!extend(0)) {
+        throw std::runtime_error("Failed to create file: " + (parent_path / (file_stem + ".1" + file_ext)).string());
+    }
+}
+
+template <typename Backend, typename SizePolicy>
+void basic_split_stream<Backend, SizePolicy>::open(const std::vector<std::filesystem::path> &_Paths, SizePolicy _Sizes) {
+    close();
+    sizes = _Sizes;
+    segment_paths = _Paths;
+    position = 0;
+    total_size = 0;
+    writable = false;
+    clear();
+
+    segments.reserve(_Paths.size());
+    for (const auto& path : _Paths) {
+        Backend file;
+        if (!file.open(path, false)) {
+            segments.clear();
+            throw std::runtime_error("Failed to open file: " + path.string());
+        }
+        total_size += file.size();
+        segments.push_back(std::move(file));
+    }
+    if constexpr (std::is_same_v<SizePolicy, DynamicSize>) {
+        if (sizes.segment_size() == UINT64_MAX && segments.size() > 1 && segments[0].size() > 0) {
+            sizes = DynamicSize(segments[0].size());
+        }
+    }
+    for (std::size_t i = 0; i < segments.size(); ++i) {
+        uint64_t size = segments[i].size();
+        if ((i + 1 < segments.size()) ? size != sizes.segment_size() : size > sizes.segment_size()) {
+            segments.clear();
+            throw std::runtime_error("File doesn't match the segment size: " + _Paths[i].string());
+        }
+    }
+}
+
+template <typename Backend, typename SizePolicy>
+bool basic_split_stream<Backend, SizePolicy>::extend(unsigned int _Last) {
+    uint64_t segment_size = sizes.segment_size();
+    // Every file but the last is segment_size() long, a file that's skipped over is a hole
+    if (!segments.empty() && _Last >= segments.size() && segments.back().size() < segment_size && !segments.back().resize(segment_size)) {
+        return false;
+    }
+    while (segments.size() <= _Last) {
+        std::filesystem::path path = parent_path / (file_stem + "." + std::to_string(segments.size() + 1) + file_ext);
+        Backend file;
+        if (!file.open(path, true) || (segments.size() < _Last && !file.resize(segment_size))) {
+            return false;
+        }
+        segments.push_back(std::move(file));
+        segment_paths.push_back(path);
+    }
+    total_size = std::max(total_size, segment_size * _Last);
+    return true;
+}
+
+template <typename Backend, typename SizePolicy>
+uint64_t basic_split_stream<Backend, SizePolicy>::read_at(uint64_t _Off, char* _Str, uint64_t _Count) {
+    if (_Off >= total_size) {
+        return 0;
+    }
+    uint64_t count = std::min(_Count, total_size - _Off);
+    uint64_t done = 0;
+    while (done < count) {
+        uint64_t offset = _Off + done;
+        unsigned int index = segment_of(offset);
+        uint64_t pos_in_file = offset % sizes.segment_size();
+        uint64_t length = std::min(count - done, sizes.segment_size() - pos_in_file);
+        uint64_t read = segments[index].read(pos_in_file, _Str + done, length);
+        done += read;
+        if (read != length) {
+            break;
+        }
+    }
+    return done;
+}
+
+template <typename Backend, typename SizePolicy>
+uint64_t basic_split_stream<Backend, SizePolicy>::write_at(uint64_t _Off, const char* _Str, uint64_t _Count) {
+    if (!writable || _Count == 0 || !extend(segment_of(_Off + _Count - 1))) {
+        return 0;
+    }
+    uint64_t done = 0;
+    while (done < _Count) {
+        uint64_t offset = _Off + done;
+        unsigned int index = segment_of(offset);
+        uint64_t pos_in_file = offset % sizes.segment_size();
+        uint64_t length = std::min(_Count - done, sizes.segment_size() - pos_in_file);
+        uint64_t written = segments[index].write(pos_in_file, _Str + done, length);
+        done += written;
+        if (written != length) {
+            break;
+        }
+    }
+    total_size = std::max(total_size, _Off + done);
+    return done;
+}
+
+template <typename Backend, typename SizePolicy>
+basic_split_stream<Backend, SizePolicy>& basic_split_stream<Backend, SizePolicy>::read(char* _Str, std::streamsize _Count) {
+    uint64_t count = static_cast<uint64_t>(_Count);
+    last_gcount = read_at(position, _Str, count);
+    position += last_gcount;
+    if (last_gcount < count) {
+        end_of_file = true;
+        failed = true;
+    }
+    return *this;
+}
+
+template <typename Backend, typename SizePolicy>
+basic_split_stream<Backend, SizePolicy>& basic_split_stream<Backend, SizePolicy>::write(const char* _Str, std::streamsize _Count) {
+    uint64_t count = static_cast<uint64_t>(_Count);
+    uint64_t written = write_at(position, _Str, count);
+    position += written;
+    if (written < count) {
+        failed = true;
+    }
+    return *this;
+}
+
+template <typename Backend, typename SizePolicy>
+basic_split_stream<Backend, SizePolicy>& basic_split_stream<Backend, SizePolicy>::seek(uint64_t _Off, std::ios_base::seekdir _Way) {
+    switch (_Way) {
+        case std::ios_base::beg:
+            position = _Off;
+            break;
+        case std::ios_base::cur:
+            position += _Off;
+            break;
+        case std::ios_base::end:
+            position = total_size + _Off;
+            break;
+        default:
+            throw std::invalid_argument("Invalid seek direction");
+    }
+    end_of_file = false;
+    return *this;
+}
+
+template <typename Backend, typename SizePolicy>
+basic_split_stream<Backend, SizePolicy>& basic_split_stream<Backend, SizePolicy>::flush() {
+    for (auto& file : segments) {
+        if (!file.flush()) {
+            failed = true;
+        }
+    }
+    return *this;
+}
+
+template <typename Backend, typename SizePolicy>
+void basic_split_stream<Backend, SizePolicy>::close() {
+    flush();
+    for (auto& file : segments) {
+        file.close();
+    }
+    segments.clear();
+}
+
+}; // namespace split
+
+#endif // _SPLIT_BASIC_STREAM_H_
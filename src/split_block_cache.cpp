@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "split_block_cache.h"
+
+split::BlockCache::BlockCache(std::size_t _Capacity, std::size_t _Block_size, unsigned int _Shards)
+    :   block_bytes(_Block_size) {
+    if (_Block_size == 0) {
+        throw std::invalid_argument("Block size must not be 0");
+    }
+    // No more shards than blocks, every shard holds at least one
+    std::size_t blocks = std::max<std::size_t>(1, _Capacity / _Block_size);
+    std::size_t shard_count = std::min<std::size_t>(std::max(_Shards, 1u), blocks);
+    shards.reserve(shard_count);
+    for (std::size_t i = 0; i < shard_count; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+        // Memory for a block is only taken once something is stored in it
+        shards.back()->entries.resize(blocks / shard_count + (i < blocks % shard_count ? 1 : 0));
+        shards.back()->index.reserve(shards.back()->entries.size());
+    }
+}
+
+std::size_t split::BlockCache::KeyHash::operator()(const Key &_Key) const {
+    // Blocks of one stream sit next to each other, mix them so neighbours spread over the shards
+    uint64_t h = _Key.stream ^ (_Key.block * 0x9E3779B97F4A7C15ull);
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 29;
+    return static_cast<std::size_t>(h);
+}
+
+split::BlockCache::Shard& split::BlockCache::shard(const Key &_Key) {
+    // The top bits pick the shard, the map inside it works from the low ones
+    uint64_t h = KeyHash()(_Key);
+    return *shards[static_cast<std::size_t>((h >> 40) % shards.size())];
+}
+
+bool split::BlockCache::get(uint64_t _Stream, uint64_t _Block, std::size_t _Off, char* _Dst, std::size_t _Count) {
+    Key key{ _Stream, _Block };
+    Shard& s = shard(key);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(key);
+        if (it != s.index.end()) {
+            Entry& entry = s.entries[it->second];
+            if (_Off + _Count <= entry.size) {
+                entry.referenced = true;
+                std::memcpy(_Dst, entry.data.get() + _Off, _Count);
+                hit_count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    miss_count.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void split::BlockCache::put(uint64_t _Stream, uint64_t _Block, const char* _Data, std::size_t _Size) {
+    Key key{ _Stream, _Block };
+    Shard& s = shard(key);
+    std::size_t size = std::min(_Size, block_bytes);
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+        // Another reader got here first
+        Entry& entry = s.entries[it->second];
+        std::memcpy(entry.data.get(), _Data, size);
+        entry.size = size;
+        return;
+    }
+
+    // The hand gives every block it passes a second chance, and takes the first one not used since
+    while (s.entries[s.hand].used && s.entries[s.hand].referenced) {
+        s.entries[s.hand].referenced = false;
+        s.hand = (s.hand + 1) % s.entries.size();
+    }
+    Entry& victim = s.entries[s.hand];
+    if (victim.used) {
+        s.index.erase(victim.key);
+    }
+    if (!victim.data) {
+        victim.data = std::make_unique<char[]>(block_bytes);
+    }
+    std::memcpy(victim.data.get(), _Data, size);
+    victim.key = key;
+    victim.size = size;
+    victim.used = true;
+    victim.referenced = false;
+    s.index.emplace(key, s.hand);
+    s.hand = (s.hand + 1) % s.entries.size();
+}
+
+void split::BlockCache::clear() {
+    for (auto& s : shards) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->index.clear();
+        for (auto& entry : s->entries) {
+            entry.used = false;
+            entry.referenced = false;
+            entry.size = 0;
+        }
+    }
+}
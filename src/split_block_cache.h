@@ -0,0 +1,69 @@
+#ifndef _SPLIT_BLOCK_CACHE_H_
+#define _SPLIT_BLOCK_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+namespace split {
+
+// Fixed size blocks of split streams kept in memory, for reads that keep coming back to the same places.
+// Blocks are keyed by the stream and their offset in it, so several split::ifstream over the same files
+// can share one cache (ReadOptions::block_cache). The budget is spread over shards, each with its own
+// lock, and each shard evicts with the CLOCK algorithm. Safe to use from any number of threads.
+class BlockCache {
+public:
+    explicit BlockCache(std::size_t _Capacity, std::size_t _Block_size = 64 * 1024, unsigned int _Shards = 16);
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    std::size_t block_size() const { return block_bytes; }
+
+    // Copies _Count bytes at _Off inside block _Block of stream _Stream, false if it isn't cached
+    bool get(uint64_t _Stream, uint64_t _Block, std::size_t _Off, char* _Dst, std::size_t _Count);
+    // Caches a block, only the last block of a stream may be shorter than block_size()
+    void put(uint64_t _Stream, uint64_t _Block, const char* _Data, std::size_t _Size);
+    void clear();
+
+    uint64_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return miss_count.load(std::memory_order_relaxed); }
+
+private:
+    struct Key {
+        uint64_t stream;
+        uint64_t block;
+        bool operator==(const Key &_Other) const { return stream == _Other.stream && block == _Other.block; }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key &_Key) const;
+    };
+    struct Entry {
+        Key key{0, 0};
+        std::unique_ptr<char[]> data;
+        std::size_t size{0};
+        bool used{false};
+        // Set on every hit, cleared as the clock hand passes
+        bool referenced{false};
+    };
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        std::unordered_map<Key, std::size_t, KeyHash> index;
+        std::size_t hand{0};
+    };
+
+    Shard& shard(const Key &_Key);
+
+    std::size_t block_bytes;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint64_t> hit_count{0};
+    std::atomic<uint64_t> miss_count{0};
+};
+
+}; // namespace split
+
+#endif // _SPLIT_BLOCK_CACHE_H_
@@ -0,0 +1,80 @@
+#include <new>
+#include <cstdlib>
+#include <utility>
+
+#include <unistd.h>
+
+#include "split_buffer_pool.h"
+
+split::detail::PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+    : pool(std::exchange(other.pool, nullptr)),
+      buffer(std::exchange(other.buffer, nullptr)),
+      length(std::exchange(other.length, 0)) {}
+
+split::detail::PooledBuffer& split::detail::PooledBuffer::operator=(PooledBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool = std::exchange(other.pool, nullptr);
+        buffer = std::exchange(other.buffer, nullptr);
+        length = std::exchange(other.length, 0);
+    }
+    return *this;
+}
+
+split::detail::PooledBuffer::~PooledBuffer() {
+    reset();
+}
+
+void split::detail::PooledBuffer::reset() {
+    if (buffer != nullptr) {
+        pool->release(buffer, length);
+    }
+    pool = nullptr;
+    buffer = nullptr;
+    length = 0;
+}
+
+split::detail::BufferPool& split::detail::BufferPool::instance() {
+    // Never destroyed, streams in static storage may still hand buffers back during shutdown
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+std::size_t split::detail::BufferPool::alignment() {
+    static const std::size_t page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+split::detail::PooledBuffer split::detail::BufferPool::acquire(std::size_t _Size) {
+    std::size_t align = alignment();
+    _Size = (_Size + align - 1) / align * align;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = free_buffers.find(_Size);
+        if (it != free_buffers.end() && !it->second.empty()) {
+            char* buffer = it->second.back();
+            it->second.pop_back();
+            return PooledBuffer(this, buffer, _Size);
+        }
+    }
+
+    void* buffer = nullptr;
+    if (::posix_memalign(&buffer, align, _Size) != 0) {
+        throw std::bad_alloc();
+    }
+    return PooledBuffer(this, static_cast<char*>(buffer), _Size);
+}
+
+void split::detail::BufferPool::release(char* _Buffer, std::size_t _Size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<char*>& buffers = free_buffers[_Size];
+        if (buffers.size() < max_free_per_size) {
+            buffers.push_back(_Buffer);
+            return;
+        }
+    }
+    std::free(_Buffer);
+}
+
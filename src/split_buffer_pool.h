@@ -0,0 +1,62 @@
+#ifndef _SPLIT_BUFFER_POOL_H_
+#define _SPLIT_BUFFER_POOL_H_
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace split {
+namespace detail {
+
+class BufferPool;
+
+// Page aligned buffer borrowed from a BufferPool, handed back when destroyed or reset
+class PooledBuffer {
+public:
+    PooledBuffer() {};
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer();
+
+    void reset();
+    char* data() const { return buffer; }
+    std::size_t size() const { return length; }
+    explicit operator bool() const { return buffer != nullptr; }
+
+private:
+    friend class BufferPool;
+    PooledBuffer(BufferPool* _Pool, char* _Buffer, std::size_t _Size) : pool(_Pool), buffer(_Buffer), length(_Size) {};
+
+    BufferPool* pool{nullptr};
+    char* buffer{nullptr};
+    std::size_t length{0};
+};
+
+// Process wide cache of page aligned buffers, so files opening and closing reuse the same memory
+class BufferPool {
+public:
+    static BufferPool& instance();
+    static std::size_t alignment();
+
+    // _Size is rounded up to a multiple of alignment()
+    PooledBuffer acquire(std::size_t _Size);
+
+private:
+    friend class PooledBuffer;
+    BufferPool() {};
+    void release(char* _Buffer, std::size_t _Size);
+
+    // Free buffers kept around per size, anything beyond this is returned to the system
+    static constexpr std::size_t max_free_per_size = 16;
+
+    std::mutex mutex;
+    std::unordered_map<std::size_t, std::vector<char*>> free_buffers;
+};
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_BUFFER_POOL_H_
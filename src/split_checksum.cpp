@@ -0,0 +1,187 @@
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "split_checksum.h"
+
+namespace {
+
+// Reflected Castagnoli polynomial
+constexpr uint32_t crc32c_poly = 0x82F63B78;
+
+// Slicing-by-8 tables, table[0] is the classic byte at a time table
+struct Crc32cTables {
+    std::array<std::array<uint32_t, 256>, 8> table;
+
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ crc32c_poly : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (std::size_t t = 1; t < table.size(); ++t) {
+                table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32cTables& tables() {
+    static const Crc32cTables instance;
+    return instance;
+}
+
+uint32_t crc32c_table(uint32_t _Crc, const unsigned char* _Data, std::size_t _Size) {
+    const auto& t = tables().table;
+    while (_Size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, _Data, 8);
+        word ^= _Crc;
+        _Crc = t[7][word & 0xFF] ^ t[6][(word >> 8) & 0xFF] ^ t[5][(word >> 16) & 0xFF] ^ t[4][(word >> 24) & 0xFF] ^
+               t[3][(word >> 32) & 0xFF] ^ t[2][(word >> 40) & 0xFF] ^ t[1][(word >> 48) & 0xFF] ^ t[0][word >> 56];
+        _Data += 8;
+        _Size -= 8;
+    }
+    while (_Size-- > 0) {
+        _Crc = (_Crc >> 8) ^ t[0][(_Crc ^ *_Data++) & 0xFF];
+    }
+    return _Crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t _Crc, const unsigned char* _Data, std::size_t _Size) {
+    uint64_t crc = _Crc;
+    while (_Size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, _Data, 8);
+        crc = _mm_crc32_u64(crc, word);
+        _Data += 8;
+        _Size -= 8;
+    }
+    uint32_t crc32 = static_cast<uint32_t>(crc);
+    while (_Size-- > 0) {
+        crc32 = _mm_crc32_u8(crc32, *_Data++);
+    }
+    return crc32;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+uint32_t crc32c_hw(uint32_t _Crc, const unsigned char* _Data, std::size_t _Size) {
+    while (_Size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, _Data, 8);
+        _Crc = __crc32cd(_Crc, word);
+        _Data += 8;
+        _Size -= 8;
+    }
+    while (_Size-- > 0) {
+        _Crc = __crc32cb(_Crc, *_Data++);
+    }
+    return _Crc;
+}
+#endif
+
+using Crc32cFunction = uint32_t (*)(uint32_t, const unsigned char*, std::size_t);
+
+Crc32cFunction select_crc32c() {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return crc32c_hw;
+    }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    return crc32c_hw;
+#endif
+    return crc32c_table;
+}
+
+// a * b modulo the polynomial, both reflected
+uint32_t multiply_mod(uint32_t _A, uint32_t _B) {
+    uint32_t product = 0;
+    for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1) {
+        if (_A & mask) {
+            product ^= _B;
+        }
+        _B = (_B & 1) ? (_B >> 1) ^ crc32c_poly : _B >> 1;
+    }
+    return product;
+}
+
+// x^(2^k) modulo the polynomial for k = 0..66, to shift a CRC past any number of zero bits
+struct PowerTable {
+    std::array<uint32_t, 67> power;
+
+    PowerTable() {
+        uint32_t p = 1u << 30; // x^1
+        for (auto& entry : power) {
+            entry = p;
+            p = multiply_mod(p, p);
+        }
+    }
+};
+
+}; // namespace
+
+uint32_t split::detail::crc32c(uint32_t _Crc, const void* _Data, std::size_t _Size) {
+    static const Crc32cFunction function = select_crc32c();
+    return ~function(~_Crc, static_cast<const unsigned char*>(_Data), _Size);
+}
+
+uint32_t split::detail::crc32c_combine(uint32_t _Crc_a, uint32_t _Crc_b, uint64_t _Size_b) {
+    static const PowerTable powers;
+
+    // Multiply crc a by x^(8 * size b), one squaring of x per bit of the size
+    uint32_t shift = 1u << 31; // x^0
+    unsigned int k = 3;
+    for (uint64_t n = _Size_b; n != 0; n >>= 1, ++k) {
+        if (n & 1) {
+            shift = multiply_mod(powers.power[k], shift);
+        }
+    }
+    return multiply_mod(shift, _Crc_a) ^ _Crc_b;
+}
+
+bool split::detail::write_checksum_file(const std::filesystem::path &_Path, const std::vector<ChecksumEntry> &_Entries) {
+    std::ofstream out(_Path, std::ios::trunc);
+    for (const auto& entry : _Entries) {
+        out << "crc32c " << std::hex << std::setw(8) << std::setfill('0') << entry.crc << std::dec << " " << entry.size << " " << entry.name << "\n";
+    }
+    out.close();
+    return !out.fail();
+}
+
+bool split::detail::read_checksum_file(const std::filesystem::path &_Path, std::vector<ChecksumEntry> &_Entries) {
+    std::ifstream in(_Path);
+    if (!in.is_open()) {
+        return false;
+    }
+
+    _Entries.clear();
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string algorithm;
+        ChecksumEntry entry;
+        fields >> algorithm >> std::hex >> entry.crc >> std::dec >> entry.size;
+        if (fields.fail() || algorithm != "crc32c") {
+            return false;
+        }
+        // The name is the rest of the line, it may contain spaces
+        std::getline(fields >> std::ws, entry.name);
+        _Entries.push_back(std::move(entry));
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef _SPLIT_CHECKSUM_H_
+#define _SPLIT_CHECKSUM_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+namespace split {
+namespace detail {
+
+// CRC-32C (Castagnoli) of _Size bytes, continuing from _Crc, which is 0 for the first block. Uses the
+// SSE4.2/ARMv8 CRC instructions when the CPU has them and a table otherwise.
+uint32_t crc32c(uint32_t _Crc, const void* _Data, std::size_t _Size);
+
+// CRC-32C of two blocks one after the other, from the CRCs of each and the size of the second
+uint32_t crc32c_combine(uint32_t _Crc_a, uint32_t _Crc_b, uint64_t _Size_b);
+
+// One line of a checksum file: the CRC-32C and size of a file, or of the whole stream
+struct ChecksumEntry {
+    uint32_t crc;
+    uint64_t size;
+    std::string name;
+};
+
+// Checksum files are text, one "crc32c <hex crc> <size> <name>" line per entry. ofstream writes the
+// whole stream first and then each file in order.
+bool write_checksum_file(const std::filesystem::path &_Path, const std::vector<ChecksumEntry> &_Entries);
+bool read_checksum_file(const std::filesystem::path &_Path, std::vector<ChecksumEntry> &_Entries);
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_CHECKSUM_H_
@@ -0,0 +1,198 @@
+#include <cstring>
+#include <vector>
+
+#include "split_compress.h"
+
+namespace {
+
+constexpr std::size_t min_match = 4;
+// The last match has to start this far before the end of the input, and the last bytes are always literals
+constexpr std::size_t match_limit = 12;
+constexpr std::size_t last_literals = 5;
+constexpr std::size_t max_distance = 65535;
+constexpr unsigned int hash_bits = 16;
+
+inline uint32_t read32(const char* _Ptr) {
+    uint32_t value;
+    std::memcpy(&value, _Ptr, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash(uint32_t _Sequence) {
+    return (_Sequence * 2654435761u) >> (32 - hash_bits);
+}
+
+// Appends the 255-run encoding of a length that didn't fit in its token nibble
+inline void put_length(char*& _Op, std::size_t _Length) {
+    while (_Length >= 255) {
+        *_Op++ = static_cast<char>(255);
+        _Length -= 255;
+    }
+    *_Op++ = static_cast<char>(_Length);
+}
+
+// Room needed for a sequence: token, literal length bytes, literals, offset and match length bytes
+inline std::size_t sequence_bound(std::size_t _Literals, std::size_t _Match) {
+    return 1 + _Literals / 255 + 1 + _Literals + 2 + _Match / 255 + 1;
+}
+
+// Reads the extra bytes of a length, false if they run past the end
+inline bool get_length(const unsigned char*& _Ip, const unsigned char* _End, std::size_t& _Length) {
+    unsigned char byte;
+    do {
+        if (_Ip >= _End) {
+            return false;
+        }
+        byte = *_Ip++;
+        _Length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}; // namespace
+
+std::size_t split::detail::lz4_bound(std::size_t _Size) {
+    return _Size + _Size / 255 + 16;
+}
+
+std::size_t split::detail::lz4_compress(const char* _Src, std::size_t _Size, char* _Dst, std::size_t _Capacity) {
+    // Positions + 1 of the last sequence seen for each hash, 0 for none. One table per thread.
+    thread_local std::vector<uint32_t> table;
+    table.assign(std::size_t(1) << hash_bits, 0);
+
+    char* op = _Dst;
+    char* op_end = _Dst + _Capacity;
+    std::size_t anchor = 0;
+    std::size_t ip = 0;
+
+    if (_Size > match_limit) {
+        std::size_t limit = _Size - match_limit;
+        std::size_t misses = 0;
+
+        while (ip < limit) {
+            uint32_t sequence = read32(_Src + ip);
+            uint32_t h = hash(sequence);
+            std::size_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(ip + 1);
+
+            if (candidate == 0 || ip - (candidate - 1) > max_distance || read32(_Src + candidate - 1) != sequence) {
+                // Skip ahead faster the longer nothing matches, incompressible data goes by quickly
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            std::size_t ref = candidate - 1;
+
+            // Extend the match backwards over the pending literals, then forwards
+            while (ip > anchor && ref > 0 && _Src[ip - 1] == _Src[ref - 1]) {
+                --ip;
+                --ref;
+            }
+            std::size_t length = min_match;
+            std::size_t match_end = _Size - last_literals;
+            while (ip + length < match_end && _Src[ip + length] == _Src[ref + length]) {
+                ++length;
+            }
+
+            std::size_t literals = ip - anchor;
+            if (static_cast<std::size_t>(op_end - op) < sequence_bound(literals, length)) {
+                return 0;
+            }
+
+            char* token = op++;
+            *token = static_cast<char>((literals >= 15 ? 15 : literals) << 4);
+            if (literals >= 15) {
+                put_length(op, literals - 15);
+            }
+            std::memcpy(op, _Src + anchor, literals);
+            op += literals;
+
+            std::size_t offset = ip - ref;
+            *op++ = static_cast<char>(offset & 0xFF);
+            *op++ = static_cast<char>(offset >> 8);
+
+            std::size_t match_code = length - min_match;
+            *token = static_cast<char>(*token | (match_code >= 15 ? 15 : match_code));
+            if (match_code >= 15) {
+                put_length(op, match_code - 15);
+            }
+
+            ip += length;
+            anchor = ip;
+            if (ip - 2 < limit) {
+                // Cheap extra entry so the next match is found sooner
+                table[hash(read32(_Src + ip - 2))] = static_cast<uint32_t>(ip - 2 + 1);
+            }
+        }
+    }
+
+    // Whatever's left goes out as literals
+    std::size_t literals = _Size - anchor;
+    if (static_cast<std::size_t>(op_end - op) < 1 + literals / 255 + 1 + literals) {
+        return 0;
+    }
+    *op++ = static_cast<char>((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        put_length(op, literals - 15);
+    }
+    std::memcpy(op, _Src + anchor, literals);
+    op += literals;
+    return static_cast<std::size_t>(op - _Dst);
+}
+
+bool split::detail::lz4_decompress(const char* _Src, std::size_t _Compressed_size, char* _Dst, std::size_t _Size) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(_Src);
+    const unsigned char* ip_end = ip + _Compressed_size;
+    std::size_t op = 0;
+
+    while (ip < ip_end) {
+        unsigned char token = *ip++;
+
+        std::size_t literals = token >> 4;
+        if (literals == 15 && !get_length(ip, ip_end, literals)) {
+            return false;
+        }
+        if (literals > static_cast<std::size_t>(ip_end - ip) || literals > _Size - op) {
+            return false;
+        }
+        std::memcpy(_Dst + op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == ip_end) {
+            // The last sequence has no match
+            break;
+        }
+
+        if (ip_end - ip < 2) {
+            return false;
+        }
+        std::size_t offset = ip[0] | (std::size_t(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        std::size_t length = token & 15;
+        if (length == 15 && !get_length(ip, ip_end, length)) {
+            return false;
+        }
+        length += min_match;
+        if (length > _Size - op) {
+            return false;
+        }
+
+        char* dst = _Dst + op;
+        const char* src = dst - offset;
+        if (offset >= length) {
+            std::memcpy(dst, src, length);
+        } else {
+            // Overlapping copy repeats the last offset bytes
+            for (std::size_t i = 0; i < length; ++i) {
+                dst[i] = src[i];
+            }
+        }
+        op += length;
+    }
+    return op == _Size;
+}
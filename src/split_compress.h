@@ -0,0 +1,28 @@
+#ifndef _SPLIT_COMPRESS_H_
+#define _SPLIT_COMPRESS_H_
+
+#include <cstdint>
+#include <cstddef>
+
+namespace split {
+
+enum class Compression : uint32_t {
+    none = 0,
+    lz4 = 1
+};
+
+namespace detail {
+
+// LZ4 block format (no frame header), compatible with LZ4_compress_default()/LZ4_decompress_safe()
+
+// Largest compressed size for _Size input bytes
+std::size_t lz4_bound(std::size_t _Size);
+// Compresses into _Dst, returns the compressed size or 0 if it doesn't fit in _Capacity bytes
+std::size_t lz4_compress(const char* _Src, std::size_t _Size, char* _Dst, std::size_t _Capacity);
+// Decompresses a block that expands to exactly _Size bytes, false if the block is damaged
+bool lz4_decompress(const char* _Src, std::size_t _Compressed_size, char* _Dst, std::size_t _Size);
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_COMPRESS_H_
@@ -0,0 +1,398 @@
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <vector>
+#include <climits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include "split_file.h"
+
+split::detail::MappedFile::MappedFile(MappedFile&& other) noexcept
+    : address(std::exchange(other.address, nullptr)),
+      length(std::exchange(other.length, 0)),
+      mapped(std::exchange(other.mapped, false)) {}
+
+split::detail::MappedFile& split::detail::MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        address = std::exchange(other.address, nullptr);
+        length = std::exchange(other.length, 0);
+        mapped = std::exchange(other.mapped, false);
+    }
+    return *this;
+}
+
+split::detail::MappedFile::~MappedFile() {
+    unmap();
+}
+
+bool split::detail::MappedFile::map(const std::filesystem::path &_Path) {
+    unmap();
+
+    int fd = ::open(_Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap() rejects zero length mappings, an empty file is still a valid (empty) mapping
+    if (st.st_size > 0) {
+        void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        address = addr;
+    }
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    length = static_cast<uint64_t>(st.st_size);
+    mapped = true;
+    return true;
+}
+
+void split::detail::MappedFile::unmap() {
+    if (address != nullptr) {
+        ::munmap(address, static_cast<size_t>(length));
+    }
+    address = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+bool split::detail::create_file(const std::filesystem::path &_Path, uint64_t _Reserve) {
+    int fd = ::open(_Path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (_Reserve > 0) {
+        // Only a hint for the allocator, the file works the same where this isn't supported
+        ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(_Reserve));
+    }
+#else
+    (void)_Reserve;
+#endif
+    ::close(fd);
+    return true;
+}
+
+bool split::detail::resize_file(const std::filesystem::path &_Path, uint64_t _Size) {
+    return ::truncate(_Path.c_str(), static_cast<off_t>(_Size)) == 0;
+}
+
+int split::detail::open_file(const std::filesystem::path &_Path, bool _Write) {
+    return ::open(_Path.c_str(), (_Write ? O_WRONLY : O_RDONLY) | O_CLOEXEC);
+}
+
+int split::detail::open_direct(const std::filesystem::path &_Path) {
+#if defined(O_DIRECT)
+    return ::open(_Path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+#else
+    return -1;
+#endif
+}
+
+void split::detail::close_fd(int _Fd) {
+    if (_Fd >= 0) {
+        ::close(_Fd);
+    }
+}
+
+uint64_t split::detail::pread_all(int _Fd, void* _Buf, uint64_t _Count, uint64_t _Off) {
+    char* buf = static_cast<char*>(_Buf);
+    uint64_t done = 0;
+    while (done < _Count) {
+        ssize_t ret = ::pread(_Fd, buf + done, static_cast<size_t>(_Count - done), static_cast<off_t>(_Off + done));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        done += static_cast<uint64_t>(ret);
+    }
+    return done;
+}
+
+uint64_t split::detail::pwrite_all(int _Fd, const void* _Buf, uint64_t _Count, uint64_t _Off) {
+    const char* buf = static_cast<const char*>(_Buf);
+    uint64_t done = 0;
+    while (done < _Count) {
+        ssize_t ret = ::pwrite(_Fd, buf + done, static_cast<size_t>(_Count - done), static_cast<off_t>(_Off + done));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        done += static_cast<uint64_t>(ret);
+    }
+    return done;
+}
+
+namespace {
+
+template <typename Op>
+uint64_t transfer_vec(int _Fd, const split::IoVec* _Vec, std::size_t _Count, uint64_t _Off, Op _Op) {
+    std::vector<struct iovec> vec(_Count);
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < _Count; ++i) {
+        vec[i].iov_base = _Vec[i].base;
+        vec[i].iov_len = _Vec[i].len;
+        total += _Vec[i].len;
+    }
+
+    struct iovec* first = vec.data();
+    std::size_t left = _Count;
+    uint64_t done = 0;
+
+    while (done < total) {
+        // Skip buffers that are already done, trim the one that was partially transferred
+        while (left > 0 && first->iov_len == 0) {
+            ++first;
+            --left;
+        }
+        int batch = static_cast<int>(std::min<std::size_t>(left, IOV_MAX));
+        ssize_t ret = _Op(_Fd, first, batch, static_cast<off_t>(_Off + done));
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        done += static_cast<uint64_t>(ret);
+
+        size_t advance = static_cast<size_t>(ret);
+        while (advance > 0) {
+            size_t step = std::min(advance, first->iov_len);
+            first->iov_base = static_cast<char*>(first->iov_base) + step;
+            first->iov_len -= step;
+            advance -= step;
+            if (first->iov_len == 0 && advance > 0) {
+                ++first;
+                --left;
+            }
+        }
+    }
+    return done;
+}
+
+} // namespace
+
+uint64_t split::detail::preadv_all(int _Fd, const IoVec* _Vec, std::size_t _Count, uint64_t _Off) {
+    return transfer_vec(_Fd, _Vec, _Count, _Off, ::preadv);
+}
+
+uint64_t split::detail::pwritev_all(int _Fd, const IoVec* _Vec, std::size_t _Count, uint64_t _Off) {
+    return transfer_vec(_Fd, _Vec, _Count, _Off, ::pwritev);
+}
+
+uint64_t split::detail::copy_range(int _In, uint64_t _In_off, int _Out, uint64_t _Out_off, uint64_t _Count) {
+    // Each call is kept well below the 2 GiB the kernel moves at once
+    const uint64_t step = 1024 * 1024 * 1024;
+    uint64_t done = 0;
+
+#if defined(__linux__)
+    while (done < _Count) {
+        loff_t in_off = static_cast<loff_t>(_In_off + done);
+        loff_t out_off = static_cast<loff_t>(_Out_off + done);
+        ssize_t ret = ::copy_file_range(_In, &in_off, _Out, &out_off, static_cast<size_t>(std::min(_Count - done, step)), 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        done += static_cast<uint64_t>(ret);
+    }
+
+    // Older kernels don't copy across filesystems with copy_file_range(), sendfile() writes at the file
+    // position instead of an offset
+    if (done < _Count && ::lseek(_Out, static_cast<off_t>(_Out_off + done), SEEK_SET) >= 0) {
+        while (done < _Count) {
+            off_t in_off = static_cast<off_t>(_In_off + done);
+            ssize_t ret = ::sendfile(_Out, _In, &in_off, static_cast<size_t>(std::min(_Count - done, step)));
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                break;
+            }
+            done += static_cast<uint64_t>(ret);
+        }
+    }
+#endif
+
+    if (done < _Count) {
+        std::vector<char> buffer(static_cast<std::size_t>(std::min<uint64_t>(_Count - done, 1024 * 1024)));
+        while (done < _Count) {
+            uint64_t length = std::min<uint64_t>(_Count - done, buffer.size());
+            uint64_t read = pread_all(_In, buffer.data(), length, _In_off + done);
+            uint64_t written = pwrite_all(_Out, buffer.data(), read, _Out_off + done);
+            done += written;
+            if (read != length || written != read) {
+                break;
+            }
+        }
+    }
+    return done;
+}
+
+split::detail::FileTable::~FileTable() {
+    close_all();
+    for (auto& block : blocks) {
+        delete[] block.load(std::memory_order_relaxed);
+    }
+}
+
+split::detail::FileTable::Slot& split::detail::FileTable::slot(unsigned int _Index) const {
+    return blocks[_Index >> block_bits].load(std::memory_order_acquire)[_Index & (block_size - 1)];
+}
+
+unsigned int split::detail::FileTable::add(const std::filesystem::path &_Path) {
+    unsigned int index = count.load(std::memory_order_relaxed);
+    if ((index >> block_bits) >= max_blocks) {
+        throw std::length_error("Too many files");
+    }
+
+    if (blocks[index >> block_bits].load(std::memory_order_relaxed) == nullptr) {
+        blocks[index >> block_bits].store(new Slot[block_size], std::memory_order_release);
+    }
+    slot(index).path = _Path;
+
+    // Publishing the count makes the slot visible to get() on other threads
+    count.store(index + 1, std::memory_order_release);
+    return index;
+}
+
+const std::filesystem::path& split::detail::FileTable::path(unsigned int _Index) const {
+    return slot(_Index).path;
+}
+
+int split::detail::FileTable::get(unsigned int _Index) {
+    if (_Index >= size()) {
+        return -1;
+    }
+
+    int fd = slot(_Index).fd.load(std::memory_order_acquire);
+    if (fd >= 0) {
+        return fd;
+    }
+    std::lock_guard<std::mutex> lock(open_mutex);
+    return open_slot(_Index);
+}
+
+split::detail::FileTable::Handle split::detail::FileTable::acquire(unsigned int _Index) {
+    if (_Index >= size()) {
+        return Handle();
+    }
+
+    // Counted before the descriptor is looked at: evict() takes the descriptor away before it checks
+    // for users, so either it sees this one or this sees the descriptor gone and opens it again
+    Slot& file = slot(_Index);
+    file.users.fetch_add(1);
+    int fd = file.fd.load();
+    if (fd < 0) {
+        std::lock_guard<std::mutex> lock(open_mutex);
+        fd = open_slot(_Index);
+    }
+    if (fd < 0) {
+        file.users.fetch_sub(1, std::memory_order_release);
+        return Handle();
+    }
+    if (!file.referenced.load(std::memory_order_relaxed)) {
+        file.referenced.store(true, std::memory_order_relaxed);
+    }
+    return Handle(&file.users, fd);
+}
+
+int split::detail::FileTable::open_slot(unsigned int _Index) {
+    Slot& file = slot(_Index);
+    int fd = file.fd.load(std::memory_order_acquire);
+    if (fd >= 0) {
+        return fd;
+    }
+    if (max_open > 0 && open_files.size() >= max_open) {
+        evict();
+    }
+    int flags = (access == Access::read) ? O_RDONLY : (O_WRONLY | O_CREAT);
+    fd = ::open(file.path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        file.fd.store(fd);
+        open_files.push_back(_Index);
+    }
+    return fd;
+}
+
+void split::detail::FileTable::evict() {
+    // CLOCK: a file used since the hand last passed gets a second chance, one that's held is skipped.
+    // If every descriptor is held the table goes over its limit rather than wait.
+    for (std::size_t step = 0; step < open_files.size() * 2; ++step) {
+        hand %= open_files.size();
+        Slot& file = slot(open_files[hand]);
+        if (file.referenced.exchange(false, std::memory_order_relaxed)) {
+            ++hand;
+            continue;
+        }
+        int fd = file.fd.exchange(-1);
+        if (file.users.load() > 0) {
+            file.fd.store(fd);
+            ++hand;
+            continue;
+        }
+        ::close(fd);
+        open_files[hand] = open_files.back();
+        open_files.pop_back();
+        return;
+    }
+}
+
+void split::detail::FileTable::close_all() {
+    unsigned int files = size();
+    for (unsigned int i = 0; i < files; ++i) {
+        int fd = slot(i).fd.exchange(-1, std::memory_order_acq_rel);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    open_files.clear();
+    hand = 0;
+}
+
+split::detail::FileTable::Handle::Handle(Handle&& other) noexcept
+    : users(std::exchange(other.users, nullptr)),
+      descriptor(std::exchange(other.descriptor, -1)) {}
+
+split::detail::FileTable::Handle& split::detail::FileTable::Handle::operator=(Handle&& other) noexcept {
+    if (this != &other) {
+        reset();
+        users = std::exchange(other.users, nullptr);
+        descriptor = std::exchange(other.descriptor, -1);
+    }
+    return *this;
+}
+
+void split::detail::FileTable::Handle::reset() {
+    // Whatever was done with the descriptor happens before evict() can see it unused and close it
+    if (users != nullptr) {
+        users->fetch_sub(1, std::memory_order_release);
+    }
+    users = nullptr;
+    descriptor = -1;
+}
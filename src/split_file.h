@@ -0,0 +1,159 @@
+#ifndef _SPLIT_FILE_H_
+#define _SPLIT_FILE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace split {
+
+// One buffer of a scatter/gather list for readv()/writev(), same layout as POSIX struct iovec
+struct IoVec {
+    void* base;
+    std::size_t len;
+};
+
+// One range of a batch for read_batch()/write_batch(), size bytes at offset in the stream
+struct IoRequest {
+    uint64_t offset;
+    void* data;
+    std::size_t size;
+    // Filled in by the call, bytes transferred from the start of the range
+    std::size_t transferred{0};
+};
+
+namespace detail {
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    MappedFile() {};
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool map(const std::filesystem::path &_Path);
+    void unmap();
+
+    bool is_mapped() const { return mapped; }
+    const char* data() const { return static_cast<const char*>(address); }
+    uint64_t size() const { return length; }
+
+private:
+    void* address{nullptr};
+    uint64_t length{0};
+    bool mapped{false};
+};
+
+// Creates the file, or empties it if it already exists. _Reserve bytes of disk are allocated for it up
+// front without changing its size, where the filesystem supports it.
+bool create_file(const std::filesystem::path &_Path, uint64_t _Reserve = 0);
+// Sets the size of the file, growing it leaves a hole. Also gives back space reserved past the end.
+bool resize_file(const std::filesystem::path &_Path, uint64_t _Size);
+
+// Opens an existing file for reading, or for writing without truncating it, -1 on error
+int open_file(const std::filesystem::path &_Path, bool _Write);
+// Opens an existing file for writing with O_DIRECT, -1 if the platform or filesystem doesn't support it
+int open_direct(const std::filesystem::path &_Path);
+void close_fd(int _Fd);
+
+// Reads or writes the whole range at _Off, retrying short transfers. Returns the number of bytes
+// transferred, which is less than _Count on end of file (reads) or error.
+uint64_t pread_all(int _Fd, void* _Buf, uint64_t _Count, uint64_t _Off);
+uint64_t pwrite_all(int _Fd, const void* _Buf, uint64_t _Count, uint64_t _Off);
+// Vectored versions, a single preadv()/pwritev() for up to IOV_MAX buffers
+uint64_t preadv_all(int _Fd, const IoVec* _Vec, std::size_t _Count, uint64_t _Off);
+uint64_t pwritev_all(int _Fd, const IoVec* _Vec, std::size_t _Count, uint64_t _Off);
+// Copies _Count bytes from _In at _In_off to _Out at _Out_off without passing them through user space
+// where the kernel allows it: copy_file_range(), which can share extents on filesystems with reflinks,
+// then sendfile(), then pread()/pwrite() through a buffer. sendfile() moves the file position of _Out, so
+// _Out mustn't be used by another copy at the same time. Returns the number of bytes copied.
+uint64_t copy_range(int _In, uint64_t _In_off, int _Out, uint64_t _Out_off, uint64_t _Count);
+
+// Raw file descriptors for a list of files, opened on first use. get() and acquire() may be called from
+// any number of threads, including while add() appends more files from the owning thread. With a limit
+// on open descriptors, opening one more closes the least recently used one nobody holds.
+class FileTable {
+public:
+    enum class Access { read, write };
+
+    // Keeps a descriptor of the table open until it's destroyed or reset
+    class Handle {
+    public:
+        Handle() {};
+        Handle(Handle&& other) noexcept;
+        Handle& operator=(Handle&& other) noexcept;
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        ~Handle() { reset(); }
+
+        // -1 if the file couldn't be opened
+        int fd() const { return descriptor; }
+        void reset();
+
+    private:
+        friend class FileTable;
+        Handle(std::atomic<unsigned int>* _Users, int _Fd) : users(_Users), descriptor(_Fd) {};
+
+        std::atomic<unsigned int>* users{nullptr};
+        int descriptor{-1};
+    };
+
+    // _Max_open descriptors at most, except while more than that are held at once. 0 keeps every file
+    // open once it's been used, until close_all().
+    explicit FileTable(Access _Access, unsigned int _Max_open = 0) : access(_Access), max_open(_Max_open) {};
+    FileTable(const FileTable&) = delete;
+    FileTable& operator=(const FileTable&) = delete;
+    ~FileTable();
+
+    unsigned int add(const std::filesystem::path &_Path);
+    // Descriptor of file _Index, or -1 if it can't be opened. Only for tables without a limit, where
+    // descriptors stay open until close_all().
+    int get(unsigned int _Index);
+    // Descriptor of file _Index, kept open while the handle lives
+    Handle acquire(unsigned int _Index);
+    unsigned int size() const { return count.load(std::memory_order_acquire); }
+    const std::filesystem::path& path(unsigned int _Index) const;
+    // Not safe to call while other threads use the table
+    void close_all();
+
+private:
+    struct Slot {
+        std::filesystem::path path;
+        std::atomic<int> fd{-1};
+        // Handles holding the descriptor, and whether one was taken since the clock hand last passed
+        std::atomic<unsigned int> users{0};
+        std::atomic<bool> referenced{false};
+    };
+
+    // Slots live in fixed blocks that never move, so growing the table doesn't disturb readers
+    static constexpr unsigned int block_bits = 10;
+    static constexpr unsigned int block_size = 1u << block_bits;
+    static constexpr unsigned int max_blocks = 4096;
+
+    Slot& slot(unsigned int _Index) const;
+    // Both with open_mutex held
+    int open_slot(unsigned int _Index);
+    void evict();
+
+    Access access;
+    unsigned int max_open;
+    std::array<std::atomic<Slot*>, max_blocks> blocks{};
+    std::atomic<unsigned int> count{0};
+    std::mutex open_mutex;
+    // Files with an open descriptor and the CLOCK hand going round them, with open_mutex held
+    std::vector<unsigned int> open_files;
+    std::size_t hand{0};
+};
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_FILE_H_
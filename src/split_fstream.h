@@ -6,6 +6,25 @@
 #include <string>
 #include <filesystem>
 #include <vector>
+#include <list>
+#include <memory>
+#include <atomic>
+#include <deque>
+
+#include "split_file.h"
+#include "split_prefetcher.h"
+#include "split_thread_pool.h"
+#include "split_buffer_pool.h"
+#include "split_stats.h"
+#include "split_checksum.h"
+#include "split_sha256.h"
+#include "split_manifest.h"
+#include "split_compress.h"
+#include "split_read_ahead.h"
+#include "split_io_ring.h"
+#include "split_block_cache.h"
+#include "split_write_behind.h"
+#include "split_basic_stream.h"
 
 namespace split {
 
@@ -19,20 +38,125 @@ private:
     std::vector<std::filesystem::path> paths_;
 };
 
+struct ReadOptions {
+    // Maximum number of files split::ifstream keeps open at once. Files are opened on first use and the
+    // least recently used one is closed to make room. 0 opens every file up front. Positional reads
+    // (read_at(), read_batch(), compressed streams, the block cache and read_threads) and the prefetch
+    // thread keep their own descriptors under the same limit, so at most twice as many are open.
+    unsigned int max_open_streams{0};
+    // When reads are sequential, a background thread asks the OS to start reading this many bytes past the
+    // read position, including the start of the next file. 0 disables prefetching.
+    uint64_t prefetch_bytes{0};
+    // Size of the buffer behind each open file, taken from a shared pool of page aligned buffers.
+    // 0 keeps the standard library's default.
+    std::size_t buffer_size{0};
+    // Checksum file written by split::ofstream (WriteOptions::checksums). Each file read() or readv() reads
+    // from start to end is checked against it on the way, a mismatch sets the failbit. Reads that skip
+    // around inside a file, read_at() and view() aren't checked.
+    std::filesystem::path checksum_file;
+    // When opening from a manifest that has checksums, check files against them the same way
+    bool verify_manifest{false};
+    // Threads reading ahead of read() with positional reads, for scanning a whole stream on fast or
+    // several devices. Each thread reads read_chunk bytes at a time, which the next read() calls take
+    // in order. Seeking restarts them at the new position. 1 reads on the calling thread.
+    unsigned int read_threads{1};
+    std::size_t read_chunk{1024 * 1024 * 4};
+    // Run read_batch() through io_uring with up to io_depth reads in flight, the files registered with the
+    // kernel. Where io_uring isn't available the reads are made one after another.
+    bool io_uring{false};
+    unsigned int io_depth{64};
+    // Serve read() and read_at() from blocks kept in this cache, reading whole blocks on a miss. Streams
+    // opened on the same files share their blocks, so one cache can be handed to several of them.
+    // Reads with read_threads go around it, a scan would only push out the blocks worth keeping.
+    std::shared_ptr<BlockCache> block_cache;
+};
+
+struct WriteOptions {
+    // Threads used by write() for large buffers. The buffer is cut into parallel_chunk sized pieces along
+    // file boundaries and each thread writes its pieces with positional writes. 1 writes on the calling thread.
+    unsigned int write_threads{1};
+    uint64_t parallel_chunk{1024 * 1024 * 16};
+    // Size of the stream buffer, taken from a shared pool of page aligned buffers. Only the file being
+    // written to is kept open, so there's one buffer per ofstream. 0 keeps the standard library's default.
+    std::size_t buffer_size{0};
+    // Write with O_DIRECT, bypassing the page cache and the standard streams. Data is staged in a page
+    // aligned buffer of buffer_size bytes (4 MiB if 0), parts of it that aren't aligned to a page at the
+    // start or end of a file are written through the page cache. Falls back to ordinary positional
+    // writes where O_DIRECT isn't supported.
+    bool direct_io{false};
+    // Compute the CRC-32C of every file and of the whole stream as data is written, saved on close() to
+    // <stem><ext>.crc32c next to the files. Only writes that carry on where the last one ended can be
+    // followed, writing anywhere else (seeking back, write_at()) drops the checksums.
+    bool checksums{false};
+    // Save a split::Manifest of the files as <stem><ext>.manifest on close(), with their CRC-32C when
+    // checksums is set and they could be followed
+    bool manifest{false};
+    // Files are named <stem>.1<ext>, <stem>.2<ext>, ... while writing, and renamed on close() once the number
+    // of files is known: zero padded when there are 10 or more, <stem><ext> when there's only one. Either
+    // of these settles the names up front so close() doesn't have to rename anything: the expected size
+    // of the whole stream, or a fixed number of digits. Files that end up not matching the expected size
+    // are still renamed, as are all of them if there are too many for the number of digits.
+    uint64_t expected_size{0};
+    unsigned int name_digits{0};
+    // Write to hidden temporary files and give them their final names in one go on close(). The checksum
+    // file and manifest come last, so once the manifest is there every file is in place.
+    bool publish_on_close{false};
+    // Compress the stream in independent frames of frame_size bytes, on compression_threads threads (0 uses
+    // every core). max_filesize then limits the compressed bytes in each file and has to be at least
+    // frame_size. Compressed streams can only be written front to back with write()/writev(), and always
+    // get a manifest, which holds the frame index split::ifstream needs to read them back. The checksums,
+    // direct_io and write_threads settings don't apply.
+    Compression compression{Compression::none};
+    std::size_t frame_size{1024 * 1024};
+    unsigned int compression_threads{0};
+    // Run write_batch() through io_uring with up to io_depth writes in flight, see ReadOptions::io_uring
+    bool io_uring{false};
+    unsigned int io_depth{64};
+    // write() only copies into write_behind_buffers buffers of buffer_size bytes (4 MiB if 0), a thread
+    // of the stream's own writes them out. write() creates each file as the data reaches it and waits
+    // only when every buffer is queued. flush() waits until everything is written, and it and close()
+    // fail the stream if any write failed. direct_io and write_threads don't apply.
+    bool write_behind{false};
+    unsigned int write_behind_buffers{4};
+    // Reserve max_filesize bytes of disk for each file when it's created (fallocate, keeping the size at 0),
+    // so files written side by side don't interleave their extents. close() gives back what the last file
+    // didn't use. Ignored where the filesystem doesn't support it.
+    bool preallocate{false};
+};
+
 class ofstream {
 public:
     ofstream() {};
-    ofstream(const std::filesystem::path &_Path, const uint64_t &_Maxsize = UINT64_MAX);
+    ofstream(const std::filesystem::path &_Path, const uint64_t &_Maxsize = UINT64_MAX, const WriteOptions &_Options = WriteOptions());
     ofstream(ofstream&& other) noexcept;
     ofstream& operator=(ofstream&& other) noexcept;
     ~ofstream();
 
     bool operator!();
 
-    void open(const std::filesystem::path &_Path, const uint64_t &_Maxsize = UINT64_MAX);
+    void open(const std::filesystem::path &_Path, const uint64_t &_Maxsize = UINT64_MAX, const WriteOptions &_Options = WriteOptions());
     ofstream& seekp(uint64_t _Off, std::ios_base::seekdir _Way);
     ofstream& write(const char* _Str, std::streamsize _Count);
     uint64_t tellp();
+    ofstream& flush();
+
+    // Writes _Count bytes at _Off without touching the write position, creating files as needed. Safe to
+    // call from several threads at once, but not alongside the other members. Data written through write()
+    // may still be buffered, flush() before writing over it. Returns the number of bytes written.
+    uint64_t write_at(uint64_t _Off, const char* _Str, uint64_t _Count);
+
+    // Writes the buffers in order at the write position, each file's share of them with one vectored write
+    ofstream& writev(const IoVec* _Vec, std::size_t _Count);
+
+    // Writes every request at its offset like write_at(), with all of them in flight at once when
+    // WriteOptions::io_uring is set. Sets each request's transferred and returns the number written in
+    // full. Not safe alongside the other members.
+    std::size_t write_batch(IoRequest* _Requests, std::size_t _Count);
+
+    // Writes the whole of file _Src at the write position. Each file's share of it is copied by the kernel
+    // (see detail::copy_range()), up to _Threads files at once (0 uses every core). Compressed and direct
+    // I/O streams read it in and write() it instead. Not followed by the checksums.
+    ofstream& write_file(const std::filesystem::path &_Src, unsigned int _Threads = 0);
 
     bool is_open() const;
     bool fail() const;
@@ -42,9 +166,16 @@ public:
     void clear();
 
     PathsWrapper paths() const;
+
+    // I/O statistics and a hook called for every traced event, only when built with SPLIT_FSTREAM_STATS
+    const IoStats& stats() const { return recorder.get(); }
+    void reset_stats() { recorder.reset(); }
+    void set_trace_hook(TraceHook _Hook) { recorder.set_hook(std::move(_Hook)); }
     
 private:
     struct StreamInfo {
+        // Declared before the stream so it outlives it
+        detail::PooledBuffer buffer;
         std::ofstream stream;
         std::filesystem::path path;
         unsigned int index;
@@ -58,9 +189,80 @@ private:
 
     unsigned int current_stream{0};
     uint64_t current_position{0};
-    uint64_t max_filesize;
+    uint64_t max_filesize{UINT64_MAX};
+
+    WriteOptions options;
+    // Descriptors for positional writes, alongside the streams
+    std::unique_ptr<detail::FileTable> files;
+    // Held while files are created by write_at(), which may run on several threads
+    std::unique_ptr<std::mutex> files_mutex;
+    std::unique_ptr<detail::ThreadPool> pool;
+    // WriteOptions::io_uring, set up by the first write_batch()
+    std::unique_ptr<detail::IoRing> ring;
+    // WriteOptions::write_behind, started by the first write() and writing through write_positional()
+    std::unique_ptr<detail::WriteBehind> write_behind;
+    // Set when a write that bypasses the streams fails
+    bool io_failed{false};
+    // The stream of current_stream hasn't been moved to current_position yet
+    bool seek_pending{false};
+    // The one file with an open stream, -1 if none
+    int active_stream{-1};
+    detail::StatsRecorder recorder;
+
+    // O_DIRECT staging buffer, holding data for file direct_stream starting at direct_file_base. Valid
+    // bytes are [direct_begin, direct_end), buffer offsets share the file offsets' page alignment.
+    detail::PooledBuffer direct_buffer;
+    unsigned int direct_stream{0};
+    uint64_t direct_file_base{0};
+    std::size_t direct_begin{0};
+    std::size_t direct_end{0};
+    int direct_fd{-1};
+    int direct_fd_stream{-1};
+
+    // Running CRC-32C of each file while everything has been written in order, see WriteOptions::checksums
+    std::vector<uint32_t> checksums;
+    uint64_t checksummed_until{0};
+    std::atomic<bool> checksums_valid{false};
+
+    // Compressed mode: data collects in filling_frame until it makes a whole frame, frames are compressed
+    // on the pool and appended to the files in order, see WriteOptions::compression
+    struct PendingFrame {
+        std::vector<char> input;
+        std::vector<char> output;
+        // 0 when the frame didn't compress and is stored as it is
+        std::size_t output_size{0};
+        std::future<void> done;
+    };
+    std::unique_ptr<PendingFrame> filling_frame;
+    std::deque<std::unique_ptr<PendingFrame>> pending_frames;
+    std::vector<std::unique_ptr<PendingFrame>> spare_frames;
+    std::vector<Manifest::Frame> frames;
+    // End of the compressed data in the last file
+    uint64_t compressed_end{0};
     
+    void open_stream(unsigned int _Index);
+    void close_stream();
+    void write_parallel(const char* _Str, uint64_t _Count);
+    void write_direct(const char* _Str, uint64_t _Count);
+    void flush_direct(bool _Final);
+    bool write_staged(unsigned int _Index, const char* _Str, uint64_t _Count, uint64_t _Off, bool _Direct);
+    void update_checksums(uint64_t _Off, const char* _Str, uint64_t _Count);
+    bool checksums_complete() const;
+    void write_checksums();
+    void write_manifest();
+    uint64_t write_positional(uint64_t _Off, const char* _Str, uint64_t _Count);
+    void ensure_files(unsigned int _Last);
+    void stop_write_behind();
+    void settle_file_sizes();
+    void start_compression();
+    void write_compressed(const char* _Str, uint64_t _Count);
+    void submit_frame();
+    void drain_frames(bool _All);
+    void store_frame(PendingFrame &_Frame);
+    unsigned int find_stream(uint64_t _Off) const;
     std::filesystem::path get_next_filepath();
+    std::filesystem::path final_path(unsigned int _Index, std::size_t _Count);
+    std::size_t expected_files() const;
     void open_new_stream();
     void rename_output_files();
     int num_digits(int number);
@@ -70,19 +272,41 @@ private:
 
 class ifstream {
 public:
+    // Read-only span over part of the stream, see view()
+    struct View {
+        const char* data{nullptr};
+        std::size_t size{0};
+
+        const char* begin() const { return data; }
+        const char* end() const { return data + size; }
+        bool empty() const { return size == 0; }
+    };
+
     ifstream() {};
     ifstream(ifstream&& other) noexcept;
     ifstream& operator=(ifstream&& other) noexcept;
-    ifstream(const std::vector<std::string> &_Paths);
-    ifstream(const std::vector<std::filesystem::path> &_Paths);
-    ifstream(const std::filesystem::path &_Path);
+    ifstream(const std::vector<std::string> &_Paths, const ReadOptions &_Options = ReadOptions());
+    ifstream(const std::vector<std::filesystem::path> &_Paths, const ReadOptions &_Options = ReadOptions());
+    ifstream(const std::vector<std::filesystem::path> &_Paths, const std::vector<uint64_t> &_Sizes, const ReadOptions &_Options = ReadOptions());
+    ifstream(const std::filesystem::path &_Path, const ReadOptions &_Options = ReadOptions());
+    // Opens the files listed in a manifest, see Manifest::load(), without touching the filesystem for their
+    // sizes. A compressed stream reads as the data before compression, each read only decompresses the
+    // frames it needs.
+    ifstream(const Manifest &_Manifest, const ReadOptions &_Options = ReadOptions());
     ~ifstream();
 
     bool operator!();
 
-    void open(const std::vector<std::string> &_Paths);
-    void open(const std::vector<std::filesystem::path> &_Paths);
-    void open(const std::filesystem::path &_Path);
+    void open(const std::vector<std::string> &_Paths, const ReadOptions &_Options = ReadOptions());
+    void open(const std::vector<std::filesystem::path> &_Paths, const ReadOptions &_Options = ReadOptions());
+    // Sizes of the files are already known (e.g. from a listing or manifest), no file is queried for its size
+    void open(const std::vector<std::filesystem::path> &_Paths, const std::vector<uint64_t> &_Sizes, const ReadOptions &_Options = ReadOptions());
+    void open(const std::filesystem::path &_Path, const ReadOptions &_Options = ReadOptions());
+    void open(const Manifest &_Manifest, const ReadOptions &_Options = ReadOptions());
+    // Finds the files split::ofstream wrote for _Base ("dir/name.ext" -> name.1.ext, name.01.ext, ...)
+    // in one pass over the directory and opens them in order. A stream that fit in one file is opened as
+    // _Base itself. Throws if no files are found or one in the middle is missing.
+    void open_split(const std::filesystem::path &_Base, const ReadOptions &_Options = ReadOptions());
 
     void push_back(const std::filesystem::path &_Path);
     uint64_t size() const;
@@ -94,29 +318,130 @@ public:
     void seekg(uint64_t _Off, std::ios_base::seekdir _Way);
     ifstream& read(char* _Str, std::streamsize _Count);
 
+    // Reads up to _Count bytes at _Off with positional reads, without touching the read position or the
+    // stream states. Safe to call from several threads at once, but not alongside the other members.
+    // Returns the number of bytes read, which is short at the end of the stream or on error.
+    uint64_t read_at(uint64_t _Off, char* _Str, uint64_t _Count) const;
+
+    // Fills the buffers in order from the read position, each file's share of them with one vectored read.
+    // gcount() reports the total number of bytes read.
+    ifstream& readv(const IoVec* _Vec, std::size_t _Count);
+
+    // Reads every request at its offset like read_at(), with all of them in flight at once when
+    // ReadOptions::io_uring is set. Sets each request's transferred and returns the number read in full.
+    // Not safe alongside the other members.
+    std::size_t read_batch(IoRequest* _Requests, std::size_t _Count);
+
+    // Copies the whole stream into the single file _Dst without touching the read position. Each file is
+    // copied by the kernel (see detail::copy_range()), up to _Threads of them at once (0 uses every core).
+    // A compressed stream is decompressed on the way. Throws if _Dst can't be created, otherwise returns the
+    // number of bytes copied, which is less than size() on error.
+    uint64_t copy_to(const std::filesystem::path &_Dst, unsigned int _Threads = 0) const;
+
+    // Returns up to _Count bytes starting at _Off without touching the read position. Ranges inside a
+    // single file point straight into a memory mapping of it, ranges crossing files are copied into an
+    // internal buffer. The view stays valid until the next call to view() or close().
+    View view(uint64_t _Off, std::size_t _Count);
+
+    // SHA-256 of each file, hashing up to _Threads of them at once (0 uses every core). Reads the files
+    // on their own, without touching the streams.
+    std::vector<Sha256::Digest> segment_digests(unsigned int _Threads = 0) const;
+
     bool is_open() const;
     bool eof() const;
     bool fail() const;
     bool bad() const;
     bool good() const;
+
+    // I/O statistics and a hook called for every traced event, only when built with SPLIT_FSTREAM_STATS.
+    // read_at() and view() aren't recorded, they may run on several threads at once.
+    const IoStats& stats() const { return recorder.get(); }
+    void reset_stats() { recorder.reset(); }
+    void set_trace_hook(TraceHook _Hook) { recorder.set_hook(std::move(_Hook)); }
     
 private:
-    void init_streams();
+    void init_streams(bool _Sizes_known = false);
+    void open_stream(unsigned int _Index);
+    void prefetch();
+    uint64_t read_parallel(char* _Str, uint64_t _Count);
+    uint64_t read_blocks(uint64_t _Off, char* _Str, uint64_t _Count) const;
+    uint64_t read_uncached(uint64_t _Off, char* _Str, uint64_t _Count) const;
+    void finish_read(const char* _Str, uint64_t _Read, uint64_t _Wanted, uint64_t _Count);
+    void update_cache_key();
+    unsigned int find_stream(uint64_t _Off) const;
+    unsigned int stream_at(uint64_t _Off) const;
 
     struct StreamInfo {
+        // Declared before the stream so it outlives it
+        detail::PooledBuffer buffer;
         std::ifstream stream;
         uint64_t size;
         std::filesystem::path path;
+        detail::MappedFile map;
+        std::list<unsigned int>::iterator lru_entry;
+        // ReadOptions::checksum_file, the CRC-32C of the first verified bytes of the file
+        bool verify{false};
+        uint32_t expected_crc{0};
+        uint32_t crc{0};
+        uint64_t verified{0};
     };
 
+    void open_file(StreamInfo &_File);
+    const char* mapped_data(unsigned int _Index);
+    void load_checksums();
+    void set_checksums(const Manifest &_Manifest);
+    void set_frames(const Manifest &_Manifest);
+    bool load_frame(std::size_t _Index, std::vector<char> &_Data, std::vector<char> &_Input) const;
+    uint64_t read_frames(uint64_t _Off, char* _Str, uint64_t _Count, std::vector<char> &_Data, std::vector<char> &_Input, std::size_t &_Cached) const;
+    void verify(unsigned int _Index, uint64_t _Off, const char* _Str, uint64_t _Count);
+
+    ReadOptions options;
+    // Indices of the open files when max_open_streams is set, most recently used first
+    std::list<unsigned int> open_streams;
+    // Descriptors for read_at(), alongside the streams
+    std::unique_ptr<detail::FileTable> files;
+    std::unique_ptr<detail::Prefetcher> prefetcher;
+    // ReadOptions::read_threads, started by the first read() and reading through read_at()
+    std::unique_ptr<detail::ReadAhead> read_ahead;
+    // ReadOptions::io_uring, set up by the first read_batch()
+    std::unique_ptr<detail::IoRing> ring;
+    uint64_t last_read_end{0};
+    uint64_t prefetched_until{0};
+    // Identifies the files in ReadOptions::block_cache
+    uint64_t cache_key{0};
+
     std::vector<StreamInfo> infiles;
+    // offsets[i] is the position of infiles[i] within the whole stream, offsets.back() == total_size
+    std::vector<uint64_t> offsets{0};
     uint64_t total_size{0};
     unsigned int current_stream{0};
     uint64_t current_position{0};
     uint64_t last_gcount{0};
     bool end_of_file{false};
+    // The stream of current_stream hasn't been moved to current_position yet
+    bool seek_pending{false};
+    std::vector<char> view_buffer;
+    // A file didn't match its checksum, a compressed frame or a chunk read ahead couldn't be read
+    bool verify_failed{false};
+
+    // Compressed streams: the frame index from the manifest and the last frame decompressed
+    Compression compression{Compression::none};
+    uint64_t frame_size{0};
+    std::vector<Manifest::Frame> frames;
+    std::vector<char> frame_data;
+    std::vector<char> frame_input;
+    std::size_t cached_frame{SIZE_MAX};
+    detail::StatsRecorder recorder;
 };
 
+// Splits the file _Src into files of at most _Maxsize bytes, named after _Path the way split::ofstream
+// names them, with ofstream::write_file(). Returns their paths, throws if _Src can't be read or a
+// copy fails.
+std::vector<std::filesystem::path> split_file(const std::filesystem::path &_Src, const std::filesystem::path &_Path, uint64_t _Maxsize, const WriteOptions &_Options = WriteOptions(), unsigned int _Threads = 0);
+// Puts the files of a split stream back together into _Dst with ifstream::copy_to(). Throws if _Dst can't
+// be created or a copy fails, returns the number of bytes copied.
+uint64_t join(const ifstream &_Src, const std::filesystem::path &_Dst, unsigned int _Threads = 0);
+
 }; // namespace split
 
 #endif // _SPLIT_FSTREAM_H_
\ No newline at end of file
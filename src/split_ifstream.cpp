@@ -1,28 +1,50 @@
 #include <algorithm>
+#include <cstring>
+#include <utility>
 
 #include "split_fstream.h"
 
 split::ifstream::ifstream(ifstream&& other) noexcept
-    : infiles(std::move(other.infiles)),
-      current_stream(other.current_stream),
-      current_position(other.current_position),
-      end_of_file(other.end_of_file),
-      total_size(other.total_size),
-      last_gcount(other.last_gcount) {}
+    : ifstream() {
+    *this = std::move(other);
+}
 
 split::ifstream& split::ifstream::operator=(ifstream&& other) noexcept {
     if (this != &other) {
+        // The read-ahead threads read through the members, both stop before anything is moved
+        read_ahead.reset();
+        other.read_ahead.reset();
         infiles = std::move(other.infiles);
+        offsets = std::move(other.offsets);
         current_stream = other.current_stream;
         current_position = other.current_position;
         end_of_file = other.end_of_file;
         total_size = other.total_size;
         last_gcount = other.last_gcount;
+        view_buffer = std::move(other.view_buffer);
+        options = other.options;
+        open_streams = std::move(other.open_streams);
+        files = std::move(other.files);
+        prefetcher = std::move(other.prefetcher);
+        ring = std::move(other.ring);
+        last_read_end = other.last_read_end;
+        prefetched_until = other.prefetched_until;
+        cache_key = other.cache_key;
+        seek_pending = other.seek_pending;
+        verify_failed = other.verify_failed;
+        compression = other.compression;
+        frame_size = other.frame_size;
+        frames = std::move(other.frames);
+        frame_data = std::move(other.frame_data);
+        frame_input = std::move(other.frame_input);
+        cached_frame = std::exchange(other.cached_frame, SIZE_MAX);
+        recorder = std::move(other.recorder);
     }
     return *this;
 }
 
-split::ifstream::ifstream(const std::vector<std::filesystem::path> &_Paths) {
+split::ifstream::ifstream(const std::vector<std::filesystem::path> &_Paths, const ReadOptions &_Options)
+    :   options(_Options) {
     infiles.resize(_Paths.size());
     for (size_t i = 0; i < _Paths.size(); i++) {
         infiles[i].path = _Paths[i];
@@ -30,7 +52,8 @@ split::ifstream::ifstream(const std::vector<std::filesystem::path> &_Paths) {
     init_streams();
 }
 
-split::ifstream::ifstream(const std::vector<std::string> &_Paths) {
+split::ifstream::ifstream(const std::vector<std::string> &_Paths, const ReadOptions &_Options)
+    :   options(_Options) {
     infiles.resize(_Paths.size());
     for (size_t i = 0; i < _Paths.size(); i++) {
         infiles[i].path = std::filesystem::absolute(_Paths[i]);
@@ -38,21 +61,42 @@ split::ifstream::ifstream(const std::vector<std::string> &_Paths) {
     init_streams();
 }
 
-split::ifstream::ifstream(const std::filesystem::path &_Path) {
+split::ifstream::ifstream(const std::vector<std::filesystem::path> &_Paths, const std::vector<uint64_t> &_Sizes, const ReadOptions &_Options)
+    :   options(_Options) {
+    if (_Paths.size() != _Sizes.size()) {
+        throw std::invalid_argument("Number of sizes does not match number of paths");
+    }
+    infiles.resize(_Paths.size());
+    for (size_t i = 0; i < _Paths.size(); i++) {
+        infiles[i].path = _Paths[i];
+        infiles[i].size = _Sizes[i];
+    }
+    init_streams(true);
+}
+
+split::ifstream::ifstream(const std::filesystem::path &_Path, const ReadOptions &_Options)
+    :   options(_Options) {
     infiles.resize(1);
     infiles[0].path = _Path;
     init_streams();
 }
 
+split::ifstream::ifstream(const Manifest &_Manifest, const ReadOptions &_Options)
+    :   ifstream(_Manifest.paths(), _Manifest.sizes(), _Options) {
+    set_checksums(_Manifest);
+    set_frames(_Manifest);
+}
+
 split::ifstream::~ifstream() {
     close();
 }
 
-void split::ifstream::open(const std::vector<std::filesystem::path> &_Paths) {
+void split::ifstream::open(const std::vector<std::filesystem::path> &_Paths, const ReadOptions &_Options) {
     if (is_open()) {
         return;
     }
     close();
+    options = _Options;
     infiles.resize(_Paths.size());
     for (size_t i = 0; i < _Paths.size(); i++) {
         infiles[i].path = _Paths[i];
@@ -60,11 +104,12 @@ void split::ifstream::open(const std::vector<std::filesystem::path> &_Paths) {
     init_streams();
 }
 
-void split::ifstream::open(const std::vector<std::string> &_Paths) {
+void split::ifstream::open(const std::vector<std::string> &_Paths, const ReadOptions &_Options) {
     if (is_open()) {
         return;
     }
     close();
+    options = _Options;
     infiles.resize(_Paths.size());
     for (size_t i = 0; i < _Paths.size(); i++) {
         infiles[i].path = std::filesystem::absolute(_Paths[i]);
@@ -72,41 +117,308 @@ void split::ifstream::open(const std::vector<std::string> &_Paths) {
     init_streams();
 }
 
-void split::ifstream::open(const std::filesystem::path &_Path) {
+void split::ifstream::open(const std::filesystem::path &_Path, const ReadOptions &_Options) {
     if (is_open()) {
         return;
     }
     close();
+    options = _Options;
     infiles.resize(1);
     infiles[0].path = _Path;
     init_streams();
 }
 
+void split::ifstream::open(const std::vector<std::filesystem::path> &_Paths, const std::vector<uint64_t> &_Sizes, const ReadOptions &_Options) {
+    if (is_open()) {
+        return;
+    }
+    if (_Paths.size() != _Sizes.size()) {
+        throw std::invalid_argument("Number of sizes does not match number of paths");
+    }
+    close();
+    options = _Options;
+    infiles.resize(_Paths.size());
+    for (size_t i = 0; i < _Paths.size(); i++) {
+        infiles[i].path = _Paths[i];
+        infiles[i].size = _Sizes[i];
+    }
+    init_streams(true);
+}
+
+void split::ifstream::open(const Manifest &_Manifest, const ReadOptions &_Options) {
+    if (is_open()) {
+        return;
+    }
+    open(_Manifest.paths(), _Manifest.sizes(), _Options);
+    set_checksums(_Manifest);
+    set_frames(_Manifest);
+}
+
+void split::ifstream::open_split(const std::filesystem::path &_Base, const ReadOptions &_Options) {
+    if (is_open()) {
+        return;
+    }
+
+    std::filesystem::path directory = _Base.parent_path();
+    std::string prefix = _Base.stem().string() + ".";
+    std::string suffix = _Base.extension().string();
+
+    // <stem>.<index><ext>, with or without zero padding
+    std::vector<std::pair<uint64_t, std::filesystem::path>> found;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory.empty() ? "." : directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (digits.size() > 19 || !std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        found.emplace_back(std::stoull(digits), directory / name);
+    }
+    if (ec) {
+        throw std::runtime_error("Failed to list directory: " + directory.string());
+    }
+
+    if (found.empty()) {
+        if (!std::filesystem::is_regular_file(_Base)) {
+            throw std::runtime_error("No split files found for: " + _Base.string());
+        }
+        open(_Base, _Options);
+        return;
+    }
+
+    std::sort(found.begin(), found.end());
+    std::vector<std::filesystem::path> paths;
+    paths.reserve(found.size());
+    for (std::size_t i = 0; i < found.size(); ++i) {
+        if (found[i].first != i + 1) {
+            // Either a duplicate (name.1.ext next to name.01.ext) or a gap
+            uint64_t missing = (found[i].first < i + 1) ? found[i].first : i + 1;
+            throw std::runtime_error((found[i].first < i + 1 ? "Duplicate split file " : "Missing split file ") +
+                                     std::to_string(missing) + " for: " + _Base.string());
+        }
+        paths.push_back(std::move(found[i].second));
+    }
+    open(paths, _Options);
+}
+
 void split::ifstream::push_back(const std::filesystem::path &_Path) {
-    StreamInfo new_stream_info = { 
-        std::ifstream(_Path, std::ios::binary), 
-        std::filesystem::file_size(_Path), 
-        std::filesystem::absolute(_Path) 
-    };
-    infiles.push_back(std::move(new_stream_info));
-    total_size += infiles.back().size;
+    read_ahead.reset();
+    infiles.emplace_back();
+    StreamInfo& file = infiles.back();
+    file.path = std::filesystem::absolute(_Path);
+    file.size = std::filesystem::file_size(_Path);
+    if (options.max_open_streams == 0) {
+        open_file(file);
+    }
+    total_size += file.size;
+    offsets.push_back(total_size);
+    files->add(file.path);
     end_of_file = false;
+    update_cache_key();
 }
 
 uint64_t split::ifstream::size() const {
     return total_size;
 }
 
-void split::ifstream::init_streams() {
+void split::ifstream::init_streams(bool _Sizes_known) {
+    total_size = 0;
+    offsets.assign(1, 0);
+    offsets.reserve(infiles.size() + 1);
+    // The prefetch thread uses the table being replaced
+    prefetcher.reset();
+    files = std::make_unique<detail::FileTable>(detail::FileTable::Access::read, options.max_open_streams);
+
     for (auto& file : infiles) {
-        file.stream.open(file.path, std::ios::binary);
-        if (!file.stream.is_open()) {
-            throw std::runtime_error("Failed to open file: " + file.path.string());
+        // With a limit on open files they're opened on first use instead
+        if (options.max_open_streams == 0) {
+            open_file(file);
+            if (!file.stream.is_open()) {
+                throw std::runtime_error("Failed to open file: " + file.path.string());
+            }
         }
 
-        file.size = std::filesystem::file_size(file.path);
+        if (!_Sizes_known) {
+            file.size = std::filesystem::file_size(file.path);
+        }
         total_size += file.size;
+        offsets.push_back(total_size);
+        files->add(file.path);
+    }
+
+    if (options.prefetch_bytes > 0) {
+        prefetcher = std::make_unique<detail::Prefetcher>(*files);
+    }
+    if (!options.checksum_file.empty()) {
+        load_checksums();
     }
+    update_cache_key();
+}
+
+void split::ifstream::update_cache_key() {
+    if (!options.block_cache) {
+        return;
+    }
+    // Paths and sizes of the files, and whether they're read decompressed, which makes a different stream
+    uint64_t key = 0xCBF29CE484222325ull ^ static_cast<uint64_t>(compression);
+    for (const auto& file : infiles) {
+        key = (key ^ std::hash<std::string>()(file.path.lexically_normal().string())) * 0x100000001B3ull;
+        key = (key ^ file.size) * 0x100000001B3ull;
+    }
+    cache_key = key;
+}
+
+void split::ifstream::load_checksums() {
+    std::vector<detail::ChecksumEntry> entries;
+    if (!detail::read_checksum_file(options.checksum_file, entries)) {
+        throw std::runtime_error("Failed to read checksum file: " + options.checksum_file.string());
+    }
+    // The whole stream comes first, then one entry per file
+    if (entries.size() != infiles.size() + 1) {
+        throw std::runtime_error("Checksum file doesn't match the files: " + options.checksum_file.string());
+    }
+
+    for (std::size_t i = 0; i < infiles.size(); ++i) {
+        StreamInfo& file = infiles[i];
+        file.verify = true;
+        file.expected_crc = entries[i + 1].crc;
+        file.crc = 0;
+        file.verified = 0;
+        if (entries[i + 1].size != file.size) {
+            verify_failed = true;
+        }
+    }
+}
+
+void split::ifstream::set_checksums(const Manifest &_Manifest) {
+    if (!options.verify_manifest || !_Manifest.has_checksums) {
+        return;
+    }
+    for (std::size_t i = 0; i < infiles.size(); ++i) {
+        StreamInfo& file = infiles[i];
+        file.verify = true;
+        file.expected_crc = _Manifest.segments[i].crc32c;
+        file.crc = 0;
+        file.verified = 0;
+    }
+}
+
+void split::ifstream::set_frames(const Manifest &_Manifest) {
+    if (_Manifest.compression == Compression::none) {
+        return;
+    }
+    // The files hold compressed frames, positions are in the data before compression from here on
+    compression = _Manifest.compression;
+    frame_size = _Manifest.frame_size;
+    frames = _Manifest.frames;
+    total_size = _Manifest.total_size();
+    cached_frame = SIZE_MAX;
+    update_cache_key();
+}
+
+bool split::ifstream::load_frame(std::size_t _Index, std::vector<char> &_Data, std::vector<char> &_Input) const {
+    const Manifest::Frame& frame = frames[_Index];
+    detail::FileTable::Handle file = files->acquire(frame.segment);
+    std::vector<char>& stored = frame.compressed ? _Input : _Data;
+    stored.resize(frame.stored_size);
+    if (file.fd() < 0 || detail::pread_all(file.fd(), stored.data(), frame.stored_size, frame.offset) != frame.stored_size) {
+        return false;
+    }
+    if (!frame.compressed) {
+        return frame.stored_size == frame.size;
+    }
+    _Data.resize(frame.size);
+    return detail::lz4_decompress(_Input.data(), frame.stored_size, _Data.data(), frame.size);
+}
+
+uint64_t split::ifstream::read_frames(uint64_t _Off, char* _Str, uint64_t _Count, std::vector<char> &_Data, std::vector<char> &_Input, std::size_t &_Cached) const {
+    // Every frame but the last holds frame_size bytes, so the frame is found without a search
+    uint64_t copied = 0;
+    while (copied < _Count && _Off < total_size) {
+        std::size_t index = static_cast<std::size_t>(_Off / frame_size);
+        if (index != _Cached) {
+            if (!load_frame(index, _Data, _Input)) {
+                _Cached = SIZE_MAX;
+                break;
+            }
+            _Cached = index;
+        }
+        uint64_t pos_in_frame = _Off - frame_size * index;
+        uint64_t take = std::min<uint64_t>(_Count - copied, _Data.size() - pos_in_frame);
+        std::memcpy(_Str + copied, _Data.data() + pos_in_frame, static_cast<std::size_t>(take));
+        copied += take;
+        _Off += take;
+    }
+    return copied;
+}
+
+void split::ifstream::verify(unsigned int _Index, uint64_t _Off, const char* _Str, uint64_t _Count) {
+    // Only a run of reads from the start of the file can be checked
+    StreamInfo& file = infiles[_Index];
+    if (!file.verify || _Off != file.verified || _Count == 0) {
+        return;
+    }
+    file.crc = detail::crc32c(file.crc, _Str, static_cast<std::size_t>(_Count));
+    file.verified += _Count;
+    if (file.verified == file.size && file.crc != file.expected_crc) {
+        verify_failed = true;
+    }
+}
+
+void split::ifstream::open_file(StreamInfo &_File) {
+    uint64_t start = recorder.start();
+    if (options.buffer_size > 0) {
+        // Has to be set before opening, the buffer goes back to the pool when the file is closed
+        _File.buffer = detail::BufferPool::instance().acquire(options.buffer_size);
+        _File.stream.rdbuf()->pubsetbuf(_File.buffer.data(), static_cast<std::streamsize>(_File.buffer.size()));
+    }
+    _File.stream.open(_File.path, std::ios::binary);
+    recorder.opened(static_cast<unsigned int>(&_File - infiles.data()), start);
+}
+
+void split::ifstream::open_stream(unsigned int _Index) {
+    if (options.max_open_streams == 0) {
+        return;
+    }
+
+    StreamInfo& file = infiles[_Index];
+    if (file.stream.is_open()) {
+        open_streams.splice(open_streams.begin(), open_streams, file.lru_entry);
+        return;
+    }
+
+    if (open_streams.size() >= options.max_open_streams) {
+        StreamInfo& evicted = infiles[open_streams.back()];
+        uint64_t start = recorder.start();
+        evicted.stream.close();
+        evicted.buffer.reset();
+        recorder.closed(open_streams.back(), start);
+        open_streams.pop_back();
+    }
+
+    open_file(file);
+    if (!file.stream.is_open()) {
+        throw std::runtime_error("Failed to open file: " + file.path.string());
+    }
+    file.lru_entry = open_streams.insert(open_streams.begin(), _Index);
+}
+
+unsigned int split::ifstream::stream_at(uint64_t _Off) const {
+    // Stream holding the byte at _Off, which must be < total_size
+    return static_cast<unsigned int>(std::upper_bound(offsets.begin(), offsets.end(), _Off) - offsets.begin() - 1);
+}
+
+unsigned int split::ifstream::find_stream(uint64_t _Off) const {
+    // First stream whose end offset is >= _Off, a position on a boundary belongs to the end of the earlier stream
+    auto it = std::lower_bound(offsets.begin() + 1, offsets.end(), _Off);
+    if (it == offsets.end()) {
+        return static_cast<unsigned int>(infiles.size() - 1);
+    }
+    return static_cast<unsigned int>(it - (offsets.begin() + 1));
 }
 
 void split::ifstream::seekg(uint64_t _Off, std::ios_base::seekdir _Way) {
@@ -135,58 +447,484 @@ void split::ifstream::seekg(uint64_t _Off, std::ios_base::seekdir _Way) {
         current_position = new_position;
     }
 
-    uint64_t bytes_left = current_position;
+    // The stream itself is only moved once it's read from, so seeking around between reads is free
+    recorder.seek(current_position);
+    current_stream = find_stream(current_position);
+    seek_pending = true;
+    end_of_file = false;
+}
+
+void split::ifstream::prefetch() {
+    if (current_position != last_read_end) {
+        // Random access, start over once reads are sequential again
+        prefetched_until = 0;
+        return;
+    }
 
-    if (bytes_left == total_size) {
-        current_stream = static_cast<unsigned int>(infiles.size() - 1);
-        infiles[current_stream].stream.seekg(0, std::ios_base::end);
-        end_of_file = infiles[current_stream].stream.eof();
+    // Top the window up once the reader is halfway through it, rather than on every read
+    uint64_t window_end = std::min(total_size, current_position + options.prefetch_bytes);
+    if (prefetched_until >= current_position + options.prefetch_bytes / 2 || prefetched_until >= window_end) {
         return;
     }
 
-    for (current_stream = 0; current_stream < infiles.size(); ++current_stream) {
-        if (bytes_left <= infiles[current_stream].size) {
-            infiles[current_stream].stream.seekg(bytes_left, std::ios::beg);
-            end_of_file = false;
-            return;
+    uint64_t start = std::max(prefetched_until, current_position);
+    std::vector<detail::Prefetcher::Range> ranges;
+
+    for (unsigned int index = find_stream(start); index < infiles.size() && offsets[index] < window_end; ++index) {
+        uint64_t range_start = std::max(start, offsets[index]);
+        uint64_t range_end = std::min(window_end, offsets[index + 1]);
+        if (range_end > range_start) {
+            ranges.push_back({ index, range_start - offsets[index], range_end - range_start });
         }
-        bytes_left -= infiles[current_stream].size;
     }
+
+    prefetcher->request(std::move(ranges));
+    prefetched_until = window_end;
 }
 
 split::ifstream& split::ifstream::read(char* _Str, std::streamsize _Count) {
     uint64_t bytes_to_read = _Count;
+    uint64_t start = recorder.start();
+    uint64_t start_position = current_position;
+    unsigned int files_read = 0;
     last_gcount = 0;
 
+    if ((options.read_threads > 1 || options.block_cache) && !infiles.empty()) {
+        // Both go through positional reads and leave the streams alone
+        uint64_t wanted = std::min<uint64_t>(_Count, total_size - current_position);
+        uint64_t got = (options.read_threads > 1) ? read_parallel(_Str, wanted) : read_blocks(current_position, _Str, wanted);
+        finish_read(_Str, got, wanted, _Count);
+        recorder.op(start_position, last_gcount, last_gcount > 0 && stream_at(start_position) != stream_at(current_position - 1), start);
+        return *this;
+    }
+
+    if (compression != Compression::none) {
+        uint64_t wanted = std::min<uint64_t>(_Count, total_size - current_position);
+        last_gcount = read_frames(current_position, _Str, wanted, frame_data, frame_input, cached_frame);
+        recorder.op(current_position, last_gcount, false, start);
+        current_position += last_gcount;
+        if (last_gcount < wanted) {
+            verify_failed = true;
+        }
+        if (last_gcount < static_cast<uint64_t>(_Count)) {
+            end_of_file = true;
+        }
+        last_read_end = current_position;
+        return *this;
+    }
+
+    if (prefetcher) {
+        prefetch();
+    }
+    open_stream(current_stream);
+    if (seek_pending) {
+        infiles[current_stream].stream.seekg(current_position - offsets[current_stream], std::ios::beg);
+        seek_pending = false;
+    }
+
     while (bytes_to_read > 0) {
-        uint64_t bytes_left_in_stream = infiles[current_stream].size - infiles[current_stream].stream.tellg();
-        
+        uint64_t bytes_left_in_stream = offsets[current_stream + 1] - current_position;
+
         if (bytes_left_in_stream >= bytes_to_read) {
             // The current stream has enough bytes to fulfill the read request
             infiles[current_stream].stream.read(_Str, bytes_to_read);
+            verify(current_stream, current_position - offsets[current_stream], _Str, infiles[current_stream].stream.gcount());
             last_gcount += infiles[current_stream].stream.gcount();
-            current_position += last_gcount;
-            return *this;
+            current_position += infiles[current_stream].stream.gcount();
+            recorder.transfer(current_stream, infiles[current_stream].stream.gcount());
+            files_read += (infiles[current_stream].stream.gcount() > 0) ? 1 : 0;
+            break;
         } else {
             // Current stream doesn't have enough bytes
             infiles[current_stream].stream.read(_Str, bytes_left_in_stream);
+            verify(current_stream, current_position - offsets[current_stream], _Str, infiles[current_stream].stream.gcount());
             last_gcount += infiles[current_stream].stream.gcount();
+            recorder.transfer(current_stream, infiles[current_stream].stream.gcount());
+            files_read += (infiles[current_stream].stream.gcount() > 0) ? 1 : 0;
             current_position += bytes_left_in_stream;
             _Str += bytes_left_in_stream;
             bytes_to_read -= bytes_left_in_stream;
-            current_stream++;
-
-            if (current_stream >= infiles.size()) {
+            if (current_stream + 1 >= infiles.size()) {
                 end_of_file = true;
-                return *this;
+                break;
             }
+            current_stream++;
 
+            open_stream(current_stream);
             infiles[current_stream].stream.seekg(0, std::ios::beg);
         }
     }
+
+    recorder.op(start_position, last_gcount, files_read > 1, start);
+    last_read_end = current_position;
     return *this;
 }
 
+uint64_t split::ifstream::read_parallel(char* _Str, uint64_t _Count) {
+    if (!read_ahead || read_ahead->position() != current_position) {
+        // Chunks of a compressed stream are whole frames, so no frame is decompressed twice
+        std::size_t chunk = options.read_chunk;
+        if (compression != Compression::none) {
+            chunk = static_cast<std::size_t>(std::max<uint64_t>(1, chunk / frame_size) * frame_size);
+        }
+        read_ahead.reset();
+        read_ahead = std::make_unique<detail::ReadAhead>(
+            [this](uint64_t _Off, char* _Dst, uint64_t _Size) { return read_uncached(_Off, _Dst, _Size); },
+            current_position, total_size, chunk, options.read_threads);
+    }
+    return read_ahead->read(_Str, _Count);
+}
+
+uint64_t split::ifstream::read_blocks(uint64_t _Off, char* _Str, uint64_t _Count) const {
+    // Misses read the whole block, which is what gets cached. One buffer per thread, read_at() may be
+    // called from several.
+    thread_local std::vector<char> block;
+    BlockCache& cache = *options.block_cache;
+    uint64_t block_size = cache.block_size();
+    uint64_t copied = 0;
+
+    while (copied < _Count) {
+        uint64_t position = _Off + copied;
+        uint64_t index = position / block_size;
+        std::size_t pos_in_block = static_cast<std::size_t>(position - index * block_size);
+        std::size_t take = static_cast<std::size_t>(std::min(_Count - copied, block_size - pos_in_block));
+        if (!cache.get(cache_key, index, pos_in_block, _Str + copied, take)) {
+            uint64_t block_start = index * block_size;
+            uint64_t block_length = std::min(block_size, total_size - block_start);
+            block.resize(static_cast<std::size_t>(block_size));
+            uint64_t got = read_uncached(block_start, block.data(), block_length);
+            if (got != block_length) {
+                // Hand over what did arrive, but don't keep a damaged block
+                uint64_t available = (got > pos_in_block) ? std::min<uint64_t>(take, got - pos_in_block) : 0;
+                std::memcpy(_Str + copied, block.data() + pos_in_block, static_cast<std::size_t>(available));
+                return copied + available;
+            }
+            cache.put(cache_key, index, block.data(), static_cast<std::size_t>(block_length));
+            std::memcpy(_Str + copied, block.data() + pos_in_block, take);
+        }
+        copied += take;
+    }
+    return copied;
+}
+
+void split::ifstream::finish_read(const char* _Str, uint64_t _Read, uint64_t _Wanted, uint64_t _Count) {
+    last_gcount = _Read;
+
+    // The data still arrives in order, so checksums are followed the same as through the streams
+    if (compression == Compression::none) {
+        uint64_t position = current_position;
+        const char* data = _Str;
+        uint64_t left = last_gcount;
+        while (left > 0) {
+            unsigned int index = stream_at(position);
+            uint64_t piece = std::min(left, offsets[index + 1] - position);
+            verify(index, position - offsets[index], data, piece);
+            position += piece;
+            data += piece;
+            left -= piece;
+        }
+    }
+
+    current_position += last_gcount;
+    if (last_gcount < _Wanted) {
+        verify_failed = true;
+    }
+    if (last_gcount < _Count) {
+        end_of_file = true;
+    }
+    // The streams aren't used, they're moved to the read position if reading on this thread again
+    current_stream = find_stream(current_position);
+    seek_pending = true;
+    last_read_end = current_position;
+}
+
+const char* split::ifstream::mapped_data(unsigned int _Index) {
+    StreamInfo& file = infiles[_Index];
+    if (!file.map.is_mapped() && !file.map.map(file.path)) {
+        throw std::runtime_error("Failed to map file: " + file.path.string());
+    }
+    if (file.map.size() < file.size) {
+        throw std::runtime_error("File changed size since it was opened: " + file.path.string());
+    }
+    return file.map.data();
+}
+
+split::ifstream::View split::ifstream::view(uint64_t _Off, std::size_t _Count) {
+    if (_Off >= total_size || _Count == 0) {
+        return {};
+    }
+    uint64_t count = std::min<uint64_t>(_Count, total_size - _Off);
+
+    if (compression != Compression::none) {
+        view_buffer.resize(static_cast<std::size_t>(count));
+        uint64_t got = read_frames(_Off, view_buffer.data(), count, frame_data, frame_input, cached_frame);
+        return { view_buffer.data(), static_cast<std::size_t>(got) };
+    }
+
+    unsigned int index = stream_at(_Off);
+    uint64_t pos_in_file = _Off - offsets[index];
+
+    if (_Off + count <= offsets[index + 1]) {
+        return { mapped_data(index) + pos_in_file, static_cast<std::size_t>(count) };
+    }
+
+    // Range crosses at least one boundary, gather it into view_buffer
+    view_buffer.resize(static_cast<std::size_t>(count));
+    char* dst = view_buffer.data();
+    uint64_t bytes_left = count;
+
+    while (bytes_left > 0) {
+        uint64_t to_copy = std::min(bytes_left, infiles[index].size - pos_in_file);
+        if (to_copy > 0) {
+            std::memcpy(dst, mapped_data(index) + pos_in_file, static_cast<std::size_t>(to_copy));
+        }
+        dst += to_copy;
+        bytes_left -= to_copy;
+        pos_in_file = 0;
+        ++index;
+    }
+    return { view_buffer.data(), view_buffer.size() };
+}
+
+uint64_t split::ifstream::read_at(uint64_t _Off, char* _Str, uint64_t _Count) const {
+    if (_Off >= total_size) {
+        return 0;
+    }
+    uint64_t count = std::min(_Count, total_size - _Off);
+    if (options.block_cache) {
+        return read_blocks(_Off, _Str, count);
+    }
+    return read_uncached(_Off, _Str, count);
+}
+
+uint64_t split::ifstream::read_uncached(uint64_t _Off, char* _Str, uint64_t _Count) const {
+    // _Count has been cut to the end of the stream
+    uint64_t count = _Count;
+
+    if (compression != Compression::none) {
+        // Own buffers, other threads may be reading too
+        std::vector<char> data;
+        std::vector<char> input;
+        std::size_t cached = SIZE_MAX;
+        return read_frames(_Off, _Str, count, data, input, cached);
+    }
+
+    unsigned int index = stream_at(_Off);
+    uint64_t pos_in_file = _Off - offsets[index];
+    uint64_t bytes_read = 0;
+
+    while (bytes_read < count) {
+        uint64_t to_read = std::min(count - bytes_read, infiles[index].size - pos_in_file);
+        if (to_read > 0) {
+            detail::FileTable::Handle file = files->acquire(index);
+            if (file.fd() < 0) {
+                break;
+            }
+            uint64_t got = detail::pread_all(file.fd(), _Str + bytes_read, to_read, pos_in_file);
+            bytes_read += got;
+            if (got != to_read) {
+                break;
+            }
+        }
+        pos_in_file = 0;
+        ++index;
+    }
+    return bytes_read;
+}
+
+std::size_t split::ifstream::read_batch(IoRequest* _Requests, std::size_t _Count) {
+    for (std::size_t i = 0; i < _Count; ++i) {
+        _Requests[i].transferred = 0;
+    }
+    if (compression != Compression::none || !files) {
+        // Frames are decompressed on the way, there's nothing to hand to the kernel as it is
+        std::size_t complete = 0;
+        for (std::size_t i = 0; i < _Count; ++i) {
+            IoRequest& request = _Requests[i];
+            request.transferred = static_cast<std::size_t>(read_at(request.offset, static_cast<char*>(request.data), request.size));
+            complete += (request.transferred == request.size) ? 1 : 0;
+        }
+        return complete;
+    }
+    if (options.io_uring && !ring) {
+        ring = std::make_unique<detail::IoRing>(options.io_depth);
+    }
+
+    // One transfer for each file a request touches, the batch holds every file it touches open
+    std::vector<detail::Transfer> transfers;
+    std::vector<detail::FileTable::Handle> held;
+    transfers.reserve(_Count);
+    for (std::size_t i = 0; i < _Count; ++i) {
+        const IoRequest& request = _Requests[i];
+        if (request.offset >= total_size) {
+            continue;
+        }
+        uint64_t end_position = std::min<uint64_t>(total_size, request.offset + request.size);
+        uint64_t position = request.offset;
+        for (unsigned int index = stream_at(position); position < end_position; ++index) {
+            uint64_t length = std::min(end_position - position, offsets[index + 1] - position);
+            if (length > 0) {
+                char* data = static_cast<char*>(request.data) + (position - request.offset);
+                held.push_back(files->acquire(index));
+                transfers.push_back({ i, index, held.back().fd(), data, length, position - offsets[index] });
+            }
+            position += length;
+        }
+    }
+    return detail::transfer_all(ring.get(), transfers, false, _Requests, _Count);
+}
+
+uint64_t split::ifstream::copy_to(const std::filesystem::path &_Dst, unsigned int _Threads) const {
+    if (!detail::create_file(_Dst)) {
+        throw std::runtime_error("Failed to create file: " + _Dst.string());
+    }
+    if (!files) {
+        return 0;
+    }
+
+    if (compression != Compression::none) {
+        // Frames are decompressed on the way, there's nothing to hand to the kernel as it is
+        int fd = detail::open_file(_Dst, true);
+        std::vector<char> buffer(static_cast<std::size_t>(std::min<uint64_t>(total_size, 1024 * 1024 * 4)));
+        std::vector<char> data;
+        std::vector<char> input;
+        std::size_t cached = SIZE_MAX;
+        uint64_t done = 0;
+        while (fd >= 0 && done < total_size) {
+            uint64_t length = std::min<uint64_t>(total_size - done, buffer.size());
+            uint64_t read = read_frames(done, buffer.data(), length, data, input, cached);
+            uint64_t written = detail::pwrite_all(fd, buffer.data(), read, done);
+            done += written;
+            if (read != length || written != read) {
+                break;
+            }
+        }
+        detail::close_fd(fd);
+        return done;
+    }
+
+    // Each file is copied to its offset through a descriptor of its own, sendfile() moves the file position
+    std::atomic<uint64_t> copied{0};
+    auto copy = [&](unsigned int _Index) {
+        detail::FileTable::Handle in = files->acquire(_Index);
+        int out = detail::open_file(_Dst, true);
+        if (in.fd() >= 0 && out >= 0) {
+            copied += detail::copy_range(in.fd(), 0, out, offsets[_Index], infiles[_Index].size);
+        }
+        detail::close_fd(out);
+    };
+    unsigned int count = static_cast<unsigned int>(infiles.size());
+    if (_Threads == 0) {
+        _Threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    _Threads = std::min(_Threads, count);
+    if (_Threads <= 1) {
+        for (unsigned int i = 0; i < count; ++i) {
+            copy(i);
+        }
+    } else {
+        detail::ThreadPool copiers(_Threads);
+        std::vector<std::future<void>> pending;
+        for (unsigned int i = 0; i < count; ++i) {
+            pending.push_back(copiers.submit([&copy, i] { copy(i); }));
+        }
+        for (auto& task : pending) {
+            task.get();
+        }
+    }
+    return copied;
+}
+
+split::ifstream& split::ifstream::readv(const IoVec* _Vec, std::size_t _Count) {
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < _Count; ++i) {
+        total += _Vec[i].len;
+    }
+
+    last_gcount = 0;
+    if (infiles.empty()) {
+        return *this;
+    }
+    if (compression != Compression::none || options.read_threads > 1) {
+        uint64_t got = 0;
+        for (std::size_t i = 0; i < _Count; ++i) {
+            read(static_cast<char*>(_Vec[i].base), static_cast<std::streamsize>(_Vec[i].len));
+            got += last_gcount;
+            if (last_gcount < _Vec[i].len) {
+                break;
+            }
+        }
+        last_gcount = got;
+        return *this;
+    }
+    uint64_t start = recorder.start();
+    unsigned int files_read = 0;
+    uint64_t end_position = std::min(total_size, current_position + total);
+    std::vector<IoVec> batch;
+    std::size_t vec_index = 0;
+    uint64_t vec_offset = 0;
+    uint64_t position = current_position;
+
+    while (position < end_position) {
+        unsigned int index = stream_at(position);
+        uint64_t pos_in_file = position - offsets[index];
+        uint64_t bytes_left = std::min(end_position, offsets[index + 1]) - position;
+        uint64_t batch_size = 0;
+        batch.clear();
+
+        while (bytes_left > 0) {
+            uint64_t take = std::min<uint64_t>(bytes_left, _Vec[vec_index].len - vec_offset);
+            if (take > 0) {
+                batch.push_back({ static_cast<char*>(_Vec[vec_index].base) + vec_offset, static_cast<std::size_t>(take) });
+            }
+            vec_offset += take;
+            bytes_left -= take;
+            batch_size += take;
+            if (vec_offset == _Vec[vec_index].len) {
+                ++vec_index;
+                vec_offset = 0;
+            }
+        }
+
+        detail::FileTable::Handle file = files->acquire(index);
+        uint64_t got = (file.fd() < 0) ? 0 : detail::preadv_all(file.fd(), batch.data(), batch.size(), pos_in_file);
+        uint64_t checked = 0;
+        for (const IoVec& part : batch) {
+            uint64_t part_size = std::min<uint64_t>(part.len, got - checked);
+            verify(index, pos_in_file + checked, static_cast<const char*>(part.base), part_size);
+            checked += part_size;
+        }
+        recorder.transfer(index, got);
+        files_read += (got > 0) ? 1 : 0;
+        position += got;
+        if (got != batch_size) {
+            infiles[index].stream.setstate(std::ios::failbit);
+            break;
+        }
+    }
+
+    last_gcount = position - current_position;
+    recorder.op(current_position, last_gcount, files_read > 1, start);
+    // Move the streams to where the vectored reads left off
+    current_position = position;
+    current_stream = find_stream(current_position);
+    seek_pending = true;
+    if (last_gcount < total) {
+        end_of_file = true;
+    }
+    last_read_end = current_position;
+    return *this;
+}
+
+std::vector<split::Sha256::Digest> split::ifstream::segment_digests(unsigned int _Threads) const {
+    std::vector<std::filesystem::path> paths;
+    paths.reserve(infiles.size());
+    for (const auto& file : infiles) {
+        paths.push_back(file.path);
+    }
+    return sha256_files(paths, _Threads);
+}
+
 uint64_t split::ifstream::tellg() {
     return current_position;
 }
@@ -204,11 +942,17 @@ bool split::ifstream::operator!() {
 }
 
 bool split::ifstream::is_open() const {
+    if (infiles.empty()) {
+        return false;
+    }
+    if (options.max_open_streams > 0) {
+        return true;
+    }
     return std::all_of(infiles.begin(), infiles.end(), [](const StreamInfo& si) { return si.stream.is_open(); });
 }
 
 bool split::ifstream::fail() const {
-    return std::any_of(infiles.begin(), infiles.end(), [](const StreamInfo& si) { return si.stream.fail(); });
+    return verify_failed || std::any_of(infiles.begin(), infiles.end(), [](const StreamInfo& si) { return si.stream.fail(); });
 }
 
 bool split::ifstream::bad() const {
@@ -216,24 +960,54 @@ bool split::ifstream::bad() const {
 }
 
 bool split::ifstream::good() const {
-    return std::all_of(infiles.begin(), infiles.end(), [](const StreamInfo& si) { return si.stream.good(); });
+    return !verify_failed && std::all_of(infiles.begin(), infiles.end(), [](const StreamInfo& si) { return si.stream.good(); });
 }
 
 void split::ifstream::clear() {
     for (auto& file : infiles) {
         file.stream.clear();
     }
+    verify_failed = false;
 }
 
 void split::ifstream::close() {
+    read_ahead.reset();
     for (auto& file : infiles) {
         if (file.stream.is_open()) {
+            uint64_t start = recorder.start();
             file.stream.close();
+            recorder.closed(static_cast<unsigned int>(&file - infiles.data()), start);
         }
+        file.buffer.reset();
     }
+    prefetcher.reset();
+    ring.reset();
+    files.reset();
+    last_read_end = 0;
+    prefetched_until = 0;
     infiles.clear();
+    open_streams.clear();
+    view_buffer.clear();
+    offsets.assign(1, 0);
+    total_size = 0;
     current_stream = 0;
     current_position = 0;
     last_gcount = 0;
     end_of_file = false;
-}
\ No newline at end of file
+    seek_pending = false;
+    verify_failed = false;
+    compression = Compression::none;
+    frame_size = 0;
+    frames.clear();
+    frame_data.clear();
+    frame_input.clear();
+    cached_frame = SIZE_MAX;
+}
+
+uint64_t split::join(const ifstream &_Src, const std::filesystem::path &_Dst, unsigned int _Threads) {
+    uint64_t copied = _Src.copy_to(_Dst, _Threads);
+    if (copied != _Src.size()) {
+        throw std::runtime_error("Failed to join files into: " + _Dst.string());
+    }
+    return copied;
+}
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define SPLIT_HAVE_IO_URING 1
+#endif
+
+#include "split_io_ring.h"
+
+#if defined(SPLIT_HAVE_IO_URING)
+
+namespace {
+
+void* map_ring(int _Fd, std::size_t _Size, off_t _Offset) {
+    void* address = ::mmap(nullptr, _Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _Fd, _Offset);
+    return address == MAP_FAILED ? nullptr : address;
+}
+
+template <typename T>
+T* at(void* _Base, uint32_t _Offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(_Base) + _Offset);
+}
+
+}; // namespace
+
+split::detail::IoRing::IoRing(unsigned int _Depth) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, std::max(_Depth, 1u), &params));
+    if (fd < 0) {
+        return;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        // Both rings share one mapping
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    sq_ring = map_ring(fd, sq_ring_size, IORING_OFF_SQ_RING);
+    cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring : map_ring(fd, cq_ring_size, IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = map_ring(fd, sqes_size, IORING_OFF_SQES);
+    ring_fd = fd;
+    if (!sq_ring || !cq_ring || !sqes) {
+        release();
+        return;
+    }
+
+    sq_tail = at<unsigned int>(sq_ring, params.sq_off.tail);
+    sq_mask = at<unsigned int>(sq_ring, params.sq_off.ring_mask);
+    sq_array = at<unsigned int>(sq_ring, params.sq_off.array);
+    cq_head = at<unsigned int>(cq_ring, params.cq_off.head);
+    cq_tail = at<unsigned int>(cq_ring, params.cq_off.tail);
+    cq_mask = at<unsigned int>(cq_ring, params.cq_off.ring_mask);
+    cqes = at<void>(cq_ring, params.cq_off.cqes);
+    depth = params.sq_entries;
+}
+
+split::detail::IoRing::~IoRing() {
+    release();
+}
+
+void split::detail::IoRing::release() {
+    if (sqes) {
+        ::munmap(sqes, sqes_size);
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        ::munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring) {
+        ::munmap(sq_ring, sq_ring_size);
+    }
+    sqes = cq_ring = sq_ring = nullptr;
+    // Closing the ring also drops the registered files
+    if (ring_fd >= 0) {
+        ::close(ring_fd);
+    }
+    ring_fd = -1;
+}
+
+bool split::detail::IoRing::register_files() {
+    if (!registered.empty()) {
+        ::syscall(__NR_io_uring_register, ring_fd, IORING_UNREGISTER_FILES, nullptr, 0);
+    }
+    // Files not opened yet are registered as -1 and filled in as they're used
+    std::size_t size = std::max<std::size_t>(64, registered.size() * 2);
+    registered.resize(size, -1);
+    return ::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, registered.data(), static_cast<unsigned int>(size)) == 0;
+}
+
+int split::detail::IoRing::fixed_file(unsigned int _File, int _Fd) {
+    if (!files_registered) {
+        return -1;
+    }
+    if (_File < registered.size() && registered[_File] == _Fd) {
+        return static_cast<int>(_File);
+    }
+
+    while (_File >= registered.size()) {
+        if (!register_files()) {
+            // Older kernels don't take -1 entries, plain descriptors work everywhere
+            files_registered = false;
+            registered.clear();
+            return -1;
+        }
+    }
+    io_uring_files_update update;
+    std::memset(&update, 0, sizeof(update));
+    update.offset = _File;
+    update.fds = reinterpret_cast<uint64_t>(&_Fd);
+    if (::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES_UPDATE, &update, 1) != 1) {
+        return -1;
+    }
+    registered[_File] = _Fd;
+    return static_cast<int>(_File);
+}
+
+void split::detail::IoRing::submit(Transfer &_Transfer, uint64_t _Tag, bool _Write) {
+    unsigned int tail = *sq_tail;
+    unsigned int index = tail & *sq_mask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode = _Write ? IORING_OP_WRITE : IORING_OP_READ;
+    int fixed = fixed_file(_Transfer.file, _Transfer.fd);
+    if (fixed >= 0) {
+        sqe->fd = fixed;
+        sqe->flags = IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = _Transfer.fd;
+    }
+    // Only the part not transferred yet, after a short completion
+    uint64_t left = std::min<uint64_t>(_Transfer.size - _Transfer.done, 1u << 30);
+    sqe->addr = reinterpret_cast<uint64_t>(_Transfer.data + _Transfer.done);
+    sqe->len = static_cast<uint32_t>(left);
+    sqe->off = _Transfer.offset + _Transfer.done;
+    sqe->user_data = _Tag;
+
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int split::detail::IoRing::enter(unsigned int _Submit, unsigned int _Wait) {
+    while (true) {
+        long result = ::syscall(__NR_io_uring_enter, ring_fd, _Submit, _Wait, _Wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (result >= 0) {
+            return static_cast<int>(result);
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+unsigned int split::detail::IoRing::reap(std::vector<Transfer> &_Transfers, std::vector<std::size_t> &_Queue) {
+    unsigned int head = *cq_head;
+    unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    unsigned int reaped = tail - head;
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & *cq_mask];
+        Transfer& transfer = _Transfers[static_cast<std::size_t>(cqe.user_data)];
+        if (cqe.res == -EAGAIN || cqe.res == -EINTR) {
+            _Queue.push_back(static_cast<std::size_t>(cqe.user_data));
+        } else if (cqe.res > 0) {
+            transfer.done += static_cast<uint64_t>(cqe.res);
+            if (transfer.done < transfer.size) {
+                _Queue.push_back(static_cast<std::size_t>(cqe.user_data));
+            } else {
+                transfer.finished = true;
+            }
+        } else if (cqe.res == 0) {
+            // End of file
+            transfer.finished = true;
+        }
+        // Any other error leaves the transfer unfinished, retried without the ring
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+void split::detail::IoRing::drain(std::vector<Transfer> &_Transfers, unsigned int _In_flight, unsigned int _Unsubmitted) {
+    // Without SQPOLL the kernel only reads the queue in io_uring_enter(), so these never started
+    __atomic_store_n(sq_tail, *sq_tail - _Unsubmitted, __ATOMIC_RELEASE);
+    _In_flight -= _Unsubmitted;
+
+    // The rest still read into or write from the caller's buffers, and a late write would land after
+    // the caller's retry. Reads and writes of regular files can't be cancelled once started, so wait.
+    std::vector<std::size_t> ignored;
+    while (_In_flight > 0) {
+        _In_flight -= reap(_Transfers, ignored);
+        if (_In_flight > 0 && enter(0, 1) < 0) {
+            // Completions still reach the ring whenever the thread returns from a system call
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+void split::detail::IoRing::run(std::vector<Transfer> &_Transfers, bool _Write) {
+    if (!valid()) {
+        return;
+    }
+
+    std::vector<std::size_t> queue;
+    queue.reserve(_Transfers.size());
+    for (std::size_t i = _Transfers.size(); i-- > 0;) {
+        if (!_Transfers[i].finished && _Transfers[i].fd >= 0) {
+            queue.push_back(i);
+        }
+    }
+
+    // Queued in the ring, of which the kernel hasn't taken unsubmitted yet
+    unsigned int in_flight = 0;
+    unsigned int unsubmitted = 0;
+    unsigned int busy = 0;
+    while (!queue.empty() || in_flight > 0) {
+        // Fill the ring, then submit and wait for at least one completion in the same call
+        while (!queue.empty() && in_flight < depth) {
+            submit(_Transfers[queue.back()], queue.back(), _Write);
+            queue.pop_back();
+            ++in_flight;
+            ++unsubmitted;
+        }
+        int submitted = enter(unsubmitted, 1);
+        if (submitted < 0 && (errno == EAGAIN || errno == EBUSY) && ++busy < 100) {
+            // Short of kernel memory or room for completions. Make room, or wait for some to arrive if
+            // the kernel has any, before trying again.
+            unsigned int reaped = reap(_Transfers, queue);
+            in_flight -= reaped;
+            bool waited = reaped == 0 && in_flight > unsubmitted && enter(0, 1) >= 0;
+            if (reaped == 0 && !waited) {
+                std::this_thread::sleep_for(std::chrono::microseconds(10 * busy));
+            }
+            continue;
+        }
+        if (submitted < 0) {
+            // The ring can't be trusted anymore, whatever hasn't finished is left to the caller
+            drain(_Transfers, in_flight, unsubmitted);
+            release();
+            return;
+        }
+        busy = 0;
+        unsubmitted -= static_cast<unsigned int>(submitted);
+        in_flight -= reap(_Transfers, queue);
+    }
+}
+
+#else
+
+split::detail::IoRing::IoRing(unsigned int) {}
+split::detail::IoRing::~IoRing() {}
+void split::detail::IoRing::release() {}
+void split::detail::IoRing::run(std::vector<Transfer> &, bool) {}
+
+#endif
+
+std::size_t split::detail::transfer_all(IoRing* _Ring, std::vector<Transfer> &_Transfers, bool _Write, IoRequest* _Requests, std::size_t _Count) {
+    if (_Ring) {
+        _Ring->run(_Transfers, _Write);
+    }
+    for (auto& transfer : _Transfers) {
+        if (transfer.finished || transfer.fd < 0) {
+            continue;
+        }
+        char* data = transfer.data + transfer.done;
+        uint64_t size = transfer.size - transfer.done;
+        uint64_t offset = transfer.offset + transfer.done;
+        transfer.done += _Write ? pwrite_all(transfer.fd, data, size, offset) : pread_all(transfer.fd, data, size, offset);
+        transfer.finished = true;
+    }
+
+    // Transfers are in order within each request
+    std::vector<bool> cut_short(_Count, false);
+    for (const auto& transfer : _Transfers) {
+        if (!cut_short[transfer.request]) {
+            _Requests[transfer.request].transferred += static_cast<std::size_t>(transfer.done);
+            cut_short[transfer.request] = transfer.done < transfer.size;
+        }
+    }
+    std::size_t complete = 0;
+    for (std::size_t i = 0; i < _Count; ++i) {
+        complete += (_Requests[i].transferred == _Requests[i].size) ? 1 : 0;
+    }
+    return complete;
+}
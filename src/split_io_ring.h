@@ -0,0 +1,87 @@
+#ifndef _SPLIT_IO_RING_H_
+#define _SPLIT_IO_RING_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "split_file.h"
+
+namespace split {
+namespace detail {
+
+// One positional read or write inside a single file of a FileTable, for part of request of a batch
+struct Transfer {
+    std::size_t request;
+    unsigned int file;
+    int fd;
+    char* data;
+    uint64_t size;
+    uint64_t offset;
+    // Bytes transferred, less than size at end of file or on error once finished
+    uint64_t done{0};
+    bool finished{false};
+};
+
+// io_uring driven straight through the system calls. Keeps up to the ring's depth of transfers in flight
+// and refers to files through a table registered with the kernel, so submissions skip the descriptor
+// lookup. Only usable from one thread at a time.
+class IoRing {
+public:
+    explicit IoRing(unsigned int _Depth);
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+    ~IoRing();
+
+    // False if the kernel doesn't support io_uring or won't allow it (seccomp, io_uring_disabled)
+    bool valid() const { return ring_fd >= 0; }
+
+    // Runs the transfers, resubmitting the rest of short ones. Transfers the ring couldn't run are left
+    // unfinished for the caller, and if the ring itself fails it's closed and valid() turns false.
+    void run(std::vector<Transfer> &_Transfers, bool _Write);
+
+private:
+    // Index of the file in the registered table, -1 to use the descriptor instead
+    int fixed_file(unsigned int _File, int _Fd);
+    bool register_files();
+    void submit(Transfer &_Transfer, uint64_t _Tag, bool _Write);
+    // Number of entries submitted, -1 on error with errno set
+    int enter(unsigned int _Submit, unsigned int _Wait);
+    // Takes the completions off the ring, queueing transfers that have more to do. Returns how many
+    unsigned int reap(std::vector<Transfer> &_Transfers, std::vector<std::size_t> &_Queue);
+    // Withdraws the entries the kernel hasn't taken and waits for the rest, before the ring is released
+    void drain(std::vector<Transfer> &_Transfers, unsigned int _In_flight, unsigned int _Unsubmitted);
+    void release();
+
+    int ring_fd{-1};
+    unsigned int depth{0};
+
+    void* sq_ring{nullptr};
+    void* cq_ring{nullptr};
+    std::size_t sq_ring_size{0};
+    std::size_t cq_ring_size{0};
+    void* sqes{nullptr};
+    std::size_t sqes_size{0};
+
+    unsigned int* sq_tail{nullptr};
+    unsigned int* sq_mask{nullptr};
+    unsigned int* sq_array{nullptr};
+    unsigned int* cq_head{nullptr};
+    unsigned int* cq_tail{nullptr};
+    unsigned int* cq_mask{nullptr};
+    void* cqes{nullptr};
+
+    // Registered descriptors by FileTable index, -1 for files not opened yet
+    std::vector<int> registered;
+    bool files_registered{true};
+};
+
+// Runs the transfers on the ring if there is one, and the ones it didn't finish with pread()/pwrite().
+// Then sets transferred on the requests, each one up to its first short transfer, and returns the number
+// of requests transferred in full.
+std::size_t transfer_all(IoRing* _Ring, std::vector<Transfer> &_Transfers, bool _Write, IoRequest* _Requests, std::size_t _Count);
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_IO_RING_H_
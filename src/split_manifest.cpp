@@ -0,0 +1,214 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "split_manifest.h"
+#include "split_checksum.h"
+
+// Binary layout, all integers little endian:
+//   "SPLITMAN"  magic
+//   u32         format version, 2 if there are frames
+//   u32         flags, bit 0: segments carry a CRC-32C, bit 1: compressed
+//   u64         number of segments
+//   per segment: u64 offset, u64 size, [u32 crc32c], u16 name length, name bytes
+//   if compressed: u32 codec, u64 frame size, u64 number of frames
+//   per frame:  u32 segment, u64 offset, u32 stored size, u32 size, u8 1 if compressed
+//   u32         CRC-32C of everything before it
+
+namespace {
+
+constexpr char magic[8] = { 'S', 'P', 'L', 'I', 'T', 'M', 'A', 'N' };
+constexpr uint32_t format_version = 1;
+constexpr uint32_t format_version_frames = 2;
+constexpr uint32_t flag_checksums = 1;
+constexpr uint32_t flag_compressed = 2;
+
+void put(std::string &_Out, uint64_t _Value, int _Bytes) {
+    for (int i = 0; i < _Bytes; ++i) {
+        _Out.push_back(static_cast<char>((_Value >> (8 * i)) & 0xFF));
+    }
+}
+
+// Reads little endian integers out of a buffer, failing instead of running past its end
+class Reader {
+public:
+    Reader(const std::string &_Data, std::size_t _End) : data(_Data), end(_End) {}
+
+    uint64_t get(int _Bytes) {
+        require(static_cast<std::size_t>(_Bytes));
+        uint64_t value = 0;
+        for (int i = 0; i < _Bytes; ++i) {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(data[position++])) << (8 * i);
+        }
+        return value;
+    }
+
+    void skip(std::size_t _Size) {
+        require(_Size);
+        position += _Size;
+    }
+
+    std::string get_string(std::size_t _Size) {
+        require(_Size);
+        std::string value = data.substr(position, _Size);
+        position += _Size;
+        return value;
+    }
+
+    bool done() const { return position == end; }
+
+private:
+    void require(std::size_t _Size) {
+        if (end - position < _Size) {
+            throw std::runtime_error("Manifest is truncated");
+        }
+    }
+
+    const std::string &data;
+    std::size_t end;
+    std::size_t position{0};
+};
+
+}; // namespace
+
+uint64_t split::Manifest::total_size() const {
+    if (compression != Compression::none) {
+        return frames.empty() ? 0 : frame_size * (frames.size() - 1) + frames.back().size;
+    }
+    return segments.empty() ? 0 : segments.back().offset + segments.back().size;
+}
+
+std::vector<std::filesystem::path> split::Manifest::paths() const {
+    std::vector<std::filesystem::path> result;
+    result.reserve(segments.size());
+    for (const auto& segment : segments) {
+        result.push_back(segment.path);
+    }
+    return result;
+}
+
+std::vector<uint64_t> split::Manifest::sizes() const {
+    std::vector<uint64_t> result;
+    result.reserve(segments.size());
+    for (const auto& segment : segments) {
+        result.push_back(segment.size);
+    }
+    return result;
+}
+
+bool split::Manifest::save(const std::filesystem::path &_Path) const {
+    bool compressed = compression != Compression::none;
+    std::string out(magic, sizeof(magic));
+    put(out, compressed ? format_version_frames : format_version, 4);
+    put(out, (has_checksums ? flag_checksums : 0) | (compressed ? flag_compressed : 0), 4);
+    put(out, segments.size(), 8);
+    for (const auto& segment : segments) {
+        std::string name = segment.path.filename().string();
+        if (name.size() > UINT16_MAX) {
+            return false;
+        }
+        put(out, segment.offset, 8);
+        put(out, segment.size, 8);
+        if (has_checksums) {
+            put(out, segment.crc32c, 4);
+        }
+        put(out, name.size(), 2);
+        out += name;
+    }
+    if (compressed) {
+        put(out, static_cast<uint32_t>(compression), 4);
+        put(out, frame_size, 8);
+        put(out, frames.size(), 8);
+        for (const auto& frame : frames) {
+            put(out, frame.segment, 4);
+            put(out, frame.offset, 8);
+            put(out, frame.stored_size, 4);
+            put(out, frame.size, 4);
+            put(out, frame.compressed ? 1 : 0, 1);
+        }
+    }
+    put(out, detail::crc32c(0, out.data(), out.size()), 4);
+
+    std::ofstream file(_Path, std::ios::binary | std::ios::trunc);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    file.close();
+    return !file.fail();
+}
+
+split::Manifest split::Manifest::load(const std::filesystem::path &_Path) {
+    std::ifstream file(_Path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open manifest: " + _Path.string());
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (data.size() < sizeof(magic) + 4 || std::memcmp(data.data(), magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a split manifest: " + _Path.string());
+    }
+    std::size_t body_size = data.size() - 4;
+    Reader trailer(data, data.size());
+    trailer.skip(body_size);
+    if (static_cast<uint32_t>(trailer.get(4)) != detail::crc32c(0, data.data(), body_size)) {
+        throw std::runtime_error("Manifest is damaged: " + _Path.string());
+    }
+
+    Reader reader(data, body_size);
+    reader.skip(sizeof(magic));
+    uint64_t version = reader.get(4);
+    if (version != format_version && version != format_version_frames) {
+        throw std::runtime_error("Unsupported manifest version: " + _Path.string());
+    }
+
+    Manifest manifest;
+    uint64_t flags = reader.get(4);
+    manifest.has_checksums = (flags & flag_checksums) != 0;
+    uint64_t count = reader.get(8);
+    std::filesystem::path directory = _Path.parent_path();
+    uint64_t expected_offset = 0;
+
+    for (uint64_t i = 0; i < count; ++i) {
+        Segment segment;
+        segment.offset = reader.get(8);
+        segment.size = reader.get(8);
+        if (manifest.has_checksums) {
+            segment.crc32c = static_cast<uint32_t>(reader.get(4));
+        }
+        segment.path = directory / reader.get_string(static_cast<std::size_t>(reader.get(2)));
+        if (segment.offset != expected_offset) {
+            throw std::runtime_error("Manifest segments aren't contiguous: " + _Path.string());
+        }
+        expected_offset += segment.size;
+        manifest.segments.push_back(std::move(segment));
+    }
+
+    if (flags & flag_compressed) {
+        manifest.compression = static_cast<Compression>(reader.get(4));
+        if (manifest.compression != Compression::lz4) {
+            throw std::runtime_error("Unsupported compression in manifest: " + _Path.string());
+        }
+        manifest.frame_size = reader.get(8);
+        if (manifest.frame_size == 0 || manifest.frame_size > UINT32_MAX) {
+            throw std::runtime_error("Manifest frame size is invalid: " + _Path.string());
+        }
+        uint64_t frame_count = reader.get(8);
+        for (uint64_t i = 0; i < frame_count; ++i) {
+            Frame frame;
+            frame.segment = static_cast<uint32_t>(reader.get(4));
+            frame.offset = reader.get(8);
+            frame.stored_size = static_cast<uint32_t>(reader.get(4));
+            frame.size = static_cast<uint32_t>(reader.get(4));
+            frame.compressed = reader.get(1) != 0;
+            // Every frame but the last is full, that's what lets a position be mapped straight to its frame
+            bool last = (i + 1 == frame_count);
+            if (frame.segment >= manifest.segments.size() || frame.offset + frame.stored_size > manifest.segments[frame.segment].size ||
+                frame.size > manifest.frame_size || (!last && frame.size != manifest.frame_size)) {
+                throw std::runtime_error("Manifest frame index doesn't match its segments: " + _Path.string());
+            }
+            manifest.frames.push_back(frame);
+        }
+    }
+    if (!reader.done()) {
+        throw std::runtime_error("Manifest has trailing data: " + _Path.string());
+    }
+    return manifest;
+}
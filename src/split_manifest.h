@@ -0,0 +1,56 @@
+#ifndef _SPLIT_MANIFEST_H_
+#define _SPLIT_MANIFEST_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "split_compress.h"
+
+namespace split {
+
+// Layout of a split stream: every file with its size and position in the stream, and optionally its
+// CRC-32C. Written by split::ofstream (WriteOptions::manifest) so split::ifstream can open the files
+// without listing the directory or asking each one for its size. Compressed streams also carry the
+// index of their frames.
+struct Manifest {
+    struct Segment {
+        std::filesystem::path path;
+        uint64_t offset{0};
+        uint64_t size{0};
+        uint32_t crc32c{0};
+    };
+
+    // A compressed block of frame_size bytes of the stream (only the last frame may be shorter), stored in
+    // one segment at offset. Frames that didn't compress are stored as they are.
+    struct Frame {
+        uint32_t segment{0};
+        uint64_t offset{0};
+        uint32_t stored_size{0};
+        uint32_t size{0};
+        bool compressed{false};
+    };
+
+    std::vector<Segment> segments;
+    // Every segment has its crc32c filled in
+    bool has_checksums{false};
+
+    Compression compression{Compression::none};
+    uint64_t frame_size{0};
+    std::vector<Frame> frames;
+
+    // Size of the stream, which for a compressed stream is the size before compression
+    uint64_t total_size() const;
+    std::vector<std::filesystem::path> paths() const;
+    std::vector<uint64_t> sizes() const;
+
+    // Segment paths are stored relative to the manifest, which has to sit in the same directory as the files.
+    // save() returns false if the file can't be written, load() throws if it can't be read or is damaged.
+    bool save(const std::filesystem::path &_Path) const;
+    static Manifest load(const std::filesystem::path &_Path);
+};
+
+}; // namespace split
+
+#endif // _SPLIT_MANIFEST_H_
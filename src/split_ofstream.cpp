@@ -2,22 +2,22 @@
 #include <iomanip>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <utility>
 
 #include "split_fstream.h"
 
 split::ofstream::ofstream(ofstream&& other) noexcept
-    : outfiles(std::move(other.outfiles)),
-      parent_path(std::move(other.parent_path)),
-      file_stem(std::move(other.file_stem)),
-      file_ext(std::move(other.file_ext)),
-      max_filesize(other.max_filesize),
-      current_stream(other.current_stream),
-      current_position(other.current_position) {
+    : ofstream() {
+    *this = std::move(other);
 }
 
 split::ofstream& split::ofstream::operator=(ofstream&& other) noexcept {
     if (this != &other) {
         close();
+        // The write-behind thread writes through the members, it stops before anything is moved
+        other.stop_write_behind();
         outfiles = std::move(other.outfiles);
         parent_path = std::move(other.parent_path);
         file_stem = std::move(other.file_stem);
@@ -25,16 +25,52 @@ split::ofstream& split::ofstream::operator=(ofstream&& other) noexcept {
         max_filesize = other.max_filesize;
         current_stream = other.current_stream;
         current_position = other.current_position;
+        options = other.options;
+        files = std::move(other.files);
+        files_mutex = std::move(other.files_mutex);
+        pool = std::move(other.pool);
+        ring = std::move(other.ring);
+        io_failed = other.io_failed;
+        seek_pending = other.seek_pending;
+        active_stream = std::exchange(other.active_stream, -1);
+        direct_buffer = std::move(other.direct_buffer);
+        direct_stream = other.direct_stream;
+        direct_file_base = other.direct_file_base;
+        direct_begin = std::exchange(other.direct_begin, 0);
+        direct_end = std::exchange(other.direct_end, 0);
+        direct_fd = std::exchange(other.direct_fd, -1);
+        direct_fd_stream = std::exchange(other.direct_fd_stream, -1);
+        checksums = std::move(other.checksums);
+        checksummed_until = other.checksummed_until;
+        checksums_valid = other.checksums_valid.exchange(false);
+        filling_frame = std::move(other.filling_frame);
+        pending_frames = std::move(other.pending_frames);
+        spare_frames = std::move(other.spare_frames);
+        frames = std::move(other.frames);
+        compressed_end = other.compressed_end;
+        recorder = std::move(other.recorder);
     }
     return *this;
 }
 
-split::ofstream::ofstream(const std::filesystem::path &_Path, const uint64_t &_Maxsize)
+split::ofstream::ofstream(const std::filesystem::path &_Path, const uint64_t &_Maxsize, const WriteOptions &_Options)
     :   parent_path(_Path.parent_path()),
         file_stem(_Path.stem().string()), 
         file_ext(_Path.extension().string()),
-        max_filesize(_Maxsize) {
+        max_filesize(_Maxsize),
+        options(_Options) {
+    checksums_valid = options.checksums;
+    if (options.compression != Compression::none) {
+        start_compression();
+        open_new_stream();
+        return;
+    }
     open_new_stream();
+    if (options.direct_io) {
+        direct_buffer = detail::BufferPool::instance().acquire(options.buffer_size > 0 ? options.buffer_size : 1024 * 1024 * 4);
+    } else if (!options.write_behind) {
+        open_stream(0);
+    }
 }
 
 split::ofstream::~ofstream() {
@@ -42,7 +78,7 @@ split::ofstream::~ofstream() {
     clean_all();
 }
 
-void split::ofstream::open(const std::filesystem::path &_Path, const uint64_t &_Maxsize) {
+void split::ofstream::open(const std::filesystem::path &_Path, const uint64_t &_Maxsize, const WriteOptions &_Options) {
     if (is_open()) {
         return;
     }
@@ -51,10 +87,31 @@ void split::ofstream::open(const std::filesystem::path &_Path, const uint64_t &_
     file_stem = _Path.stem().string(); 
     file_ext = _Path.extension().string();
     max_filesize = _Maxsize;
+    options = _Options;
+    checksums_valid = options.checksums;
+    if (options.compression != Compression::none) {
+        start_compression();
+        open_new_stream();
+        return;
+    }
     open_new_stream();
+    if (options.direct_io) {
+        direct_buffer = detail::BufferPool::instance().acquire(options.buffer_size > 0 ? options.buffer_size : 1024 * 1024 * 4);
+    } else if (!options.write_behind) {
+        open_stream(0);
+    }
 }
 
 split::ofstream& split::ofstream::seekp(uint64_t _Off, std::ios_base::seekdir _Way) {
+    if (options.compression != Compression::none) {
+        // Compressed streams are written front to back, the only place to seek to is where they already are
+        uint64_t target = (_Way == std::ios_base::beg) ? _Off : current_position + _Off;
+        if (target != current_position) {
+            io_failed = true;
+        }
+        return *this;
+    }
+
     uint64_t new_pos = 0;
     switch (_Way) {
         case std::ios_base::beg:
@@ -64,10 +121,11 @@ split::ofstream& split::ofstream::seekp(uint64_t _Off, std::ios_base::seekdir _W
             new_pos = current_position + _Off;
             break;
         case std::ios_base::end: {
-            uint64_t back_position = outfiles.back().stream.tellp();
-            outfiles.back().stream.seekp(0, std::ios::end);
-            uint64_t total_size = (outfiles.size() - 1) * max_filesize + outfiles.back().stream.tellp();
-            outfiles.back().stream.seekp(back_position, std::ios::beg);
+            // Only the last file can be shorter than max_filesize
+            flush();
+            std::error_code ec;
+            uint64_t last_size = std::filesystem::file_size(outfiles.back().path, ec);
+            uint64_t total_size = (outfiles.size() - 1) * max_filesize + (ec ? 0 : last_size);
             new_pos = total_size + _Off;
             if (new_pos > total_size) {
                 new_pos = total_size;
@@ -78,41 +136,527 @@ split::ofstream& split::ofstream::seekp(uint64_t _Off, std::ios_base::seekdir _W
             throw std::invalid_argument("Invalid seek direction");
     }
 
-    if (new_pos > current_position) {
-        while (current_stream < outfiles.size() && new_pos > max_filesize * (current_stream + 1)) {
-            ++current_stream;
-        }
-    } else {
-        while (current_stream > 0 && new_pos <= max_filesize * current_stream) {
-            --current_stream;
-        }
-    }
-
+    // The stream itself is only moved once it's written to, so seeking around between writes is free
+    recorder.seek(new_pos);
+    current_stream = find_stream(new_pos);
     current_position = new_pos;
-    uint64_t pos_in_file = current_position - max_filesize * current_stream;
-    outfiles[current_stream].stream.seekp(pos_in_file, std::ios::beg);
+    seek_pending = true;
 
     return *this;
 }
 
 split::ofstream& split::ofstream::write(const char* _Str, std::streamsize _Count) {
+    uint64_t start = recorder.start();
+    uint64_t start_position = current_position;
+    uint64_t total = static_cast<uint64_t>(_Count);
+
+    // Whether a write landed in more than one file, for the statistics
+    auto crossed = [&] {
+        return total > 0 && start_position / max_filesize != (current_position - 1) / max_filesize;
+    };
+
+    if (options.compression != Compression::none) {
+        write_compressed(_Str, total);
+        recorder.op(start_position, total, false, start);
+        return *this;
+    }
+
+    if (options.write_behind && !options.direct_io) {
+        if (!write_behind) {
+            std::size_t buffer_size = options.buffer_size > 0 ? options.buffer_size : 1024 * 1024 * 4;
+            // The files are already there, the thread only opens their descriptors and writes
+            write_behind = std::make_unique<detail::WriteBehind>([this](uint64_t _Off, const char* _Data, std::size_t _Size) {
+                return write_positional(_Off, _Data, _Size) == _Size;
+            }, buffer_size, options.write_behind_buffers);
+        }
+        // outfiles belongs to this thread, files are created here before the data is queued for them
+        if (total > 0) {
+            ensure_files(static_cast<unsigned int>((current_position + total - 1) / max_filesize));
+        }
+        update_checksums(current_position, _Str, total);
+        write_behind->write(current_position, _Str, static_cast<std::size_t>(total));
+        current_position += total;
+        if (write_behind->failed()) {
+            io_failed = true;
+        }
+        recorder.op(start_position, total, crossed(), start);
+        return *this;
+    }
+
+    if (options.write_threads > 1 && total >= options.parallel_chunk * 2) {
+        write_parallel(_Str, total);
+        recorder.op(start_position, total, crossed(), start);
+        return *this;
+    }
+
+    if (options.direct_io) {
+        write_direct(_Str, total);
+        recorder.op(start_position, total, crossed(), start);
+        return *this;
+    }
+
+    unsigned int files_written = 0;
     while (_Count > 0) {
-        uint64_t bytes_left = max_filesize - outfiles[current_stream].stream.tellp();
+        uint64_t pos_in_file = current_position - max_filesize * current_stream;
+        uint64_t bytes_left = (pos_in_file < max_filesize) ? max_filesize - pos_in_file : 0;
 
-        if (bytes_left <= 0) {
+        if (bytes_left == 0) {
             current_stream++;
             if (current_stream >= outfiles.size()) {
                 open_new_stream();
             }
+            seek_pending = true;
             continue;
         }
 
+        if (seek_pending) {
+            open_stream(current_stream);
+            outfiles[current_stream].stream.seekp(pos_in_file, std::ios::beg);
+            seek_pending = false;
+        }
+
         std::streamsize to_write = std::min(static_cast<uint64_t>(_Count), bytes_left);
-        outfiles[current_stream].stream.write(_Str, to_write);
+        update_checksums(current_position, _Str, to_write);
+        if (!outfiles[current_stream].stream.write(_Str, to_write)) {
+            // Reopening the file clears the stream's state, the failure has to outlive it
+            io_failed = true;
+        }
+        recorder.transfer(current_stream, to_write);
+        files_written++;
         _Str += to_write;
         _Count -= to_write;
         current_position += to_write;
     }
+    recorder.op(start_position, total, files_written > 1, start);
+    return *this;
+}
+
+void split::ofstream::write_parallel(const char* _Str, uint64_t _Count) {
+    if (!pool) {
+        pool = std::make_unique<detail::ThreadPool>(options.write_threads);
+    }
+
+    // Anything still buffered in the current stream has to land before the positional writes
+    flush();
+
+    uint64_t end_position = current_position + _Count;
+    while (static_cast<uint64_t>(outfiles.size()) * max_filesize < end_position) {
+        open_new_stream();
+    }
+
+    struct Piece {
+        unsigned int index;
+        uint64_t pos_in_file;
+        uint64_t length;
+        const char* data;
+    };
+    std::vector<Piece> pieces;
+    uint64_t position = current_position;
+
+    while (position < end_position) {
+        unsigned int index = static_cast<unsigned int>(position / max_filesize);
+        uint64_t pos_in_file = position - max_filesize * index;
+        uint64_t file_end = (max_filesize == UINT64_MAX) ? UINT64_MAX : max_filesize * (index + 1);
+        uint64_t length = std::min({ options.parallel_chunk, end_position - position, file_end - position });
+        pieces.push_back({ index, pos_in_file, length, _Str + (position - current_position) });
+        position += length;
+    }
+
+    // Each thread checksums its own pieces, they're chained together in order afterwards
+    bool hashing = checksums_valid && current_position == checksummed_until;
+    if (!hashing) {
+        checksums_valid = false;
+    }
+    std::vector<uint32_t> piece_crcs(hashing ? pieces.size() : 0);
+
+    std::atomic<bool> failed{false};
+    std::vector<std::future<void>> pending;
+    for (std::size_t i = 0; i < pieces.size(); ++i) {
+        recorder.transfer(pieces[i].index, pieces[i].length);
+        pending.push_back(pool->submit([this, piece = pieces[i], crc = hashing ? &piece_crcs[i] : nullptr, &failed] {
+            if (crc) {
+                *crc = detail::crc32c(0, piece.data, piece.length);
+            }
+            int fd = files->get(piece.index);
+            if (fd < 0 || detail::pwrite_all(fd, piece.data, piece.length, piece.pos_in_file) != piece.length) {
+                failed = true;
+            }
+        }));
+    }
+
+    for (auto& task : pending) {
+        task.get();
+    }
+    if (failed) {
+        io_failed = true;
+    }
+
+    if (hashing) {
+        checksums.resize(std::max<std::size_t>(checksums.size(), pieces.back().index + 1), 0);
+        for (std::size_t i = 0; i < pieces.size(); ++i) {
+            checksums[pieces[i].index] = detail::crc32c_combine(checksums[pieces[i].index], piece_crcs[i], pieces[i].length);
+        }
+        checksummed_until = end_position;
+    }
+
+    // Leave the stream of the last file written to at the new position
+    current_position = end_position;
+    current_stream = find_stream(current_position);
+    seek_pending = true;
+}
+
+void split::ofstream::write_direct(const char* _Str, uint64_t _Count) {
+    const std::size_t align = detail::BufferPool::alignment();
+
+    while (_Count > 0) {
+        uint64_t staged_end = max_filesize * direct_stream + direct_file_base + direct_end;
+        if (direct_end > direct_begin && staged_end != current_position) {
+            // Seeked away from the staged data
+            flush_direct(true);
+        }
+
+        if (direct_end == direct_begin) {
+            // Start staging at the write position, a position on a boundary starts the next file
+            direct_stream = static_cast<unsigned int>(current_position / max_filesize);
+            while (direct_stream >= outfiles.size()) {
+                open_new_stream();
+            }
+            uint64_t pos_in_file = current_position - max_filesize * direct_stream;
+            direct_begin = direct_end = static_cast<std::size_t>(pos_in_file % align);
+            direct_file_base = pos_in_file - direct_begin;
+        }
+
+        uint64_t room_in_file = max_filesize - (direct_file_base + direct_end);
+        uint64_t room = std::min<uint64_t>(direct_buffer.size() - direct_end, room_in_file);
+        if (room == 0) {
+            // Either the file or the buffer is full, only a full file needs its tail written out
+            flush_direct(room_in_file == 0);
+            continue;
+        }
+
+        uint64_t to_copy = std::min(_Count, room);
+        update_checksums(current_position, _Str, to_copy);
+        std::memcpy(direct_buffer.data() + direct_end, _Str, static_cast<std::size_t>(to_copy));
+        direct_end += static_cast<std::size_t>(to_copy);
+        _Str += to_copy;
+        _Count -= to_copy;
+        current_position += to_copy;
+    }
+    current_stream = find_stream(current_position);
+}
+
+void split::ofstream::flush_direct(bool _Final) {
+    if (direct_end == direct_begin) {
+        return;
+    }
+
+    const std::size_t align = detail::BufferPool::alignment();
+    std::size_t aligned_begin = (direct_begin + align - 1) / align * align;
+    std::size_t aligned_end = std::max(direct_end / align * align, aligned_begin);
+    char* buffer = direct_buffer.data();
+
+    // Unaligned head of the run, only when it started mid-page
+    std::size_t head_end = std::min(aligned_begin, direct_end);
+    if (head_end > direct_begin) {
+        write_staged(direct_stream, buffer + direct_begin, head_end - direct_begin, direct_file_base + direct_begin, false);
+    }
+    if (aligned_end > aligned_begin) {
+        write_staged(direct_stream, buffer + aligned_begin, aligned_end - aligned_begin, direct_file_base + aligned_begin, true);
+    }
+
+    std::size_t tail_begin = std::max(aligned_end, head_end);
+    std::size_t tail_size = direct_end - tail_begin;
+    if (_Final) {
+        // Unaligned tail at the end of a file, before a seek or on flush()/close()
+        if (tail_size > 0) {
+            write_staged(direct_stream, buffer + tail_begin, tail_size, direct_file_base + tail_begin, false);
+        }
+        direct_begin = direct_end = 0;
+    } else {
+        // Keep the partial page for the next round, it starts on a page boundary
+        std::memmove(buffer, buffer + tail_begin, tail_size);
+        direct_file_base += tail_begin;
+        direct_begin = 0;
+        direct_end = tail_size;
+    }
+}
+
+bool split::ofstream::write_staged(unsigned int _Index, const char* _Str, uint64_t _Count, uint64_t _Off, bool _Direct) {
+    int fd = -1;
+    if (_Direct) {
+        if (direct_fd_stream != static_cast<int>(_Index)) {
+            detail::close_fd(direct_fd);
+            direct_fd = detail::open_direct(outfiles[_Index].path);
+            direct_fd_stream = static_cast<int>(_Index);
+        }
+        fd = direct_fd;
+    }
+
+    // O_DIRECT unsupported here, or only some of the data went through, carry on through the page cache
+    recorder.transfer(_Index, _Count);
+    uint64_t written = (fd >= 0) ? detail::pwrite_all(fd, _Str, _Count, _Off) : 0;
+    if (written < _Count) {
+        int buffered_fd = files->get(_Index);
+        if (buffered_fd < 0 || detail::pwrite_all(buffered_fd, _Str + written, _Count - written, _Off + written) != _Count - written) {
+            io_failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t split::ofstream::write_at(uint64_t _Off, const char* _Str, uint64_t _Count) {
+    if (_Count == 0 || !files || options.compression != Compression::none) {
+        return 0;
+    }
+
+    // Not followed by the checksums, and may run on several threads at once
+    checksums_valid = false;
+    return write_positional(_Off, _Str, _Count);
+}
+
+void split::ofstream::ensure_files(unsigned int _Last) {
+    // Called from several threads by write_at()
+    if (_Last < files->size()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(*files_mutex);
+    while (_Last >= outfiles.size()) {
+        open_new_stream();
+    }
+}
+
+uint64_t split::ofstream::write_positional(uint64_t _Off, const char* _Str, uint64_t _Count) {
+    uint64_t end_position = _Off + _Count;
+    ensure_files(static_cast<unsigned int>((end_position - 1) / max_filesize));
+
+    uint64_t position = _Off;
+    while (position < end_position) {
+        unsigned int index = static_cast<unsigned int>(position / max_filesize);
+        uint64_t pos_in_file = position - max_filesize * index;
+        uint64_t length = std::min(end_position - position, max_filesize - pos_in_file);
+
+        int fd = files->get(index);
+        if (fd < 0) {
+            break;
+        }
+        uint64_t written = detail::pwrite_all(fd, _Str + (position - _Off), length, pos_in_file);
+        position += written;
+        if (written != length) {
+            break;
+        }
+    }
+    return position - _Off;
+}
+
+std::size_t split::ofstream::write_batch(IoRequest* _Requests, std::size_t _Count) {
+    uint64_t end_position = 0;
+    for (std::size_t i = 0; i < _Count; ++i) {
+        _Requests[i].transferred = 0;
+        if (_Requests[i].size > 0) {
+            end_position = std::max<uint64_t>(end_position, _Requests[i].offset + _Requests[i].size);
+        }
+    }
+    if (end_position == 0 || !files || options.compression != Compression::none) {
+        return 0;
+    }
+
+    // Not followed by the checksums, same as write_at()
+    checksums_valid = false;
+    ensure_files(static_cast<unsigned int>((end_position - 1) / max_filesize));
+    if (options.io_uring && !ring) {
+        ring = std::make_unique<detail::IoRing>(options.io_depth);
+    }
+
+    // One transfer for each file a request touches
+    std::vector<detail::Transfer> transfers;
+    transfers.reserve(_Count);
+    for (std::size_t i = 0; i < _Count; ++i) {
+        const IoRequest& request = _Requests[i];
+        uint64_t position = request.offset;
+        uint64_t request_end = request.offset + request.size;
+        while (position < request_end) {
+            unsigned int index = static_cast<unsigned int>(position / max_filesize);
+            uint64_t pos_in_file = position - max_filesize * index;
+            uint64_t length = std::min(request_end - position, max_filesize - pos_in_file);
+            char* data = static_cast<char*>(request.data) + (position - request.offset);
+            transfers.push_back({ i, index, files->get(index), data, length, pos_in_file });
+            position += length;
+        }
+    }
+    std::size_t complete = detail::transfer_all(ring.get(), transfers, true, _Requests, _Count);
+    if (complete < _Count) {
+        io_failed = true;
+    }
+    return complete;
+}
+
+split::ofstream& split::ofstream::write_file(const std::filesystem::path &_Src, unsigned int _Threads) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(_Src, ec);
+    int src = detail::open_file(_Src, false);
+    if (ec || src < 0 || !files) {
+        detail::close_fd(src);
+        io_failed = true;
+        return *this;
+    }
+
+    if (options.compression != Compression::none || options.direct_io) {
+        // Both need the data in memory anyway
+        std::vector<char> buffer(static_cast<std::size_t>(std::min<uint64_t>(size, 1024 * 1024 * 4)));
+        uint64_t done = 0;
+        while (done < size) {
+            uint64_t length = std::min<uint64_t>(size - done, buffer.size());
+            if (detail::pread_all(src, buffer.data(), length, done) != length) {
+                io_failed = true;
+                break;
+            }
+            write(buffer.data(), static_cast<std::streamsize>(length));
+            done += length;
+        }
+        detail::close_fd(src);
+        return *this;
+    }
+
+    uint64_t start = recorder.start();
+    uint64_t start_position = current_position;
+    // Whatever write() has buffered lands first, the kernel copies go around the streams
+    flush();
+    checksums_valid = false;
+
+    struct Piece {
+        unsigned int index;
+        uint64_t pos_in_file;
+        uint64_t length;
+        uint64_t src_offset;
+    };
+    uint64_t end_position = current_position + size;
+    std::vector<Piece> pieces;
+    if (size > 0) {
+        ensure_files(static_cast<unsigned int>((end_position - 1) / max_filesize));
+    }
+    for (uint64_t position = current_position; position < end_position;) {
+        unsigned int index = static_cast<unsigned int>(position / max_filesize);
+        uint64_t pos_in_file = position - max_filesize * index;
+        uint64_t length = std::min(end_position - position, max_filesize - pos_in_file);
+        pieces.push_back({ index, pos_in_file, length, position - current_position });
+        recorder.transfer(index, length);
+        position += length;
+    }
+
+    // One file per task, so no two copies share an output descriptor
+    std::atomic<bool> failed{false};
+    auto copy = [&](const Piece& _Piece) {
+        int fd = files->get(_Piece.index);
+        if (fd < 0 || detail::copy_range(src, _Piece.src_offset, fd, _Piece.pos_in_file, _Piece.length) != _Piece.length) {
+            failed = true;
+        }
+    };
+    if (_Threads == 0) {
+        _Threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    _Threads = std::min<unsigned int>(_Threads, static_cast<unsigned int>(pieces.size()));
+    if (_Threads <= 1) {
+        for (auto& piece : pieces) {
+            copy(piece);
+        }
+    } else {
+        detail::ThreadPool copiers(_Threads);
+        std::vector<std::future<void>> pending;
+        for (auto& piece : pieces) {
+            pending.push_back(copiers.submit([&copy, &piece] { copy(piece); }));
+        }
+        for (auto& task : pending) {
+            task.get();
+        }
+    }
+    detail::close_fd(src);
+    if (failed) {
+        io_failed = true;
+    }
+
+    current_position = end_position;
+    current_stream = find_stream(current_position);
+    seek_pending = true;
+    recorder.op(start_position, size, pieces.size() > 1, start);
+    return *this;
+}
+
+split::ofstream& split::ofstream::writev(const IoVec* _Vec, std::size_t _Count) {
+    uint64_t total = 0;
+    for (std::size_t i = 0; i < _Count; ++i) {
+        total += _Vec[i].len;
+    }
+    if (total == 0) {
+        return *this;
+    }
+
+    if (options.compression != Compression::none || (options.write_behind && !options.direct_io)) {
+        // Both copy into buffers of their own anyway
+        for (std::size_t i = 0; i < _Count; ++i) {
+            write(static_cast<const char*>(_Vec[i].base), static_cast<std::streamsize>(_Vec[i].len));
+        }
+        return *this;
+    }
+
+    flush();
+
+    uint64_t end_position = current_position + total;
+    while (static_cast<uint64_t>(outfiles.size()) * max_filesize < end_position) {
+        open_new_stream();
+    }
+
+    uint64_t start = recorder.start();
+    uint64_t start_position = current_position;
+    unsigned int files_written = 0;
+
+    // Gather each file's share of the buffers and write it in one go
+    std::vector<IoVec> batch;
+    std::size_t vec_index = 0;
+    uint64_t vec_offset = 0;
+    uint64_t position = current_position;
+    bool failed = false;
+
+    while (position < end_position && !failed) {
+        unsigned int index = static_cast<unsigned int>(position / max_filesize);
+        uint64_t pos_in_file = position - max_filesize * index;
+        uint64_t bytes_left = std::min(end_position - position, max_filesize - pos_in_file);
+        uint64_t batch_size = 0;
+        batch.clear();
+
+        while (bytes_left > 0) {
+            uint64_t take = std::min<uint64_t>(bytes_left, _Vec[vec_index].len - vec_offset);
+            if (take > 0) {
+                batch.push_back({ static_cast<char*>(_Vec[vec_index].base) + vec_offset, static_cast<std::size_t>(take) });
+                update_checksums(position + batch_size, static_cast<const char*>(batch.back().base), take);
+            }
+            vec_offset += take;
+            bytes_left -= take;
+            batch_size += take;
+            if (vec_offset == _Vec[vec_index].len) {
+                ++vec_index;
+                vec_offset = 0;
+            }
+        }
+
+        int fd = files->get(index);
+        uint64_t written = (fd < 0) ? 0 : detail::pwritev_all(fd, batch.data(), batch.size(), pos_in_file);
+        if (written != batch_size) {
+            // The checksums already took in bytes that never made it to the file
+            io_failed = true;
+            checksums_valid = false;
+            failed = true;
+        }
+        recorder.transfer(index, written);
+        files_written++;
+        position += written;
+    }
+
+    // Only as far as the data actually got
+    current_position = position;
+    current_stream = find_stream(current_position);
+    seek_pending = true;
+    recorder.op(start_position, position - start_position, files_written > 1, start);
     return *this;
 }
 
@@ -120,86 +664,450 @@ uint64_t split::ofstream::tellp() {
     return current_position;
 }
 
+split::ofstream& split::ofstream::flush() {
+    if (write_behind && !write_behind->flush()) {
+        io_failed = true;
+    }
+    // A partial frame stays put, only the last frame of a stream may be short
+    drain_frames(true);
+    flush_direct(true);
+    if (active_stream >= 0 && !outfiles[active_stream].stream.flush()) {
+        io_failed = true;
+    }
+    return *this;
+}
+
 bool split::ofstream::operator!() {
     return !good();
 }
 
 bool split::ofstream::is_open() const {
+    // Direct I/O doesn't use the streams, it holds its staging buffer while open
+    if (options.direct_io) {
+        return static_cast<bool>(direct_buffer);
+    }
+    // Neither do compression and write-behind, the files are there until close()
+    if (options.compression != Compression::none || options.write_behind) {
+        return static_cast<bool>(files);
+    }
     return std::any_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.is_open(); });
 }
 
 bool split::ofstream::fail() const {
-    return std::any_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.fail(); });
+    return io_failed || std::any_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.fail(); });
 }
 
 bool split::ofstream::bad() const {
-    return std::any_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.bad(); });
+    return io_failed || std::any_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.bad(); });
 }
 
 bool split::ofstream::good() const {
-    return std::all_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.good(); });
+    return !io_failed && std::all_of(outfiles.begin(), outfiles.end(), [](const StreamInfo& si) { return si.stream.good(); });
 }
 
 void split::ofstream::clear() {
     for (auto& file : outfiles) {
         file.stream.clear();
     }
+    io_failed = false;
 }
 
 void split::ofstream::close() {
-    for (auto& file : outfiles) {
-        file.stream.close();
+    stop_write_behind();
+    if (filling_frame && !filling_frame->input.empty()) {
+        submit_frame();
     }
+    drain_frames(true);
+    flush_direct(true);
+    detail::close_fd(direct_fd);
+    direct_fd = -1;
+    direct_fd_stream = -1;
+    direct_buffer.reset();
+    close_stream();
+    pool.reset();
+    ring.reset();
+    // close() runs again from the destructor, only the first one has anything to finish
+    bool was_open = static_cast<bool>(files);
+    files.reset();
+    if (was_open) {
+        settle_file_sizes();
+    }
+
+    uint64_t start = recorder.start();
     rename_output_files();
+    recorder.renamed(start);
+
+    if (was_open && options.checksums) {
+        write_checksums();
+    }
+    if (was_open && (options.manifest || options.compression != Compression::none)) {
+        write_manifest();
+    }
+    checksums_valid = false;
 }
 
-void split::ofstream::clean_all() {
-    for (auto& file : outfiles) {
-        if (file.stream.is_open()) {
-            file.stream.close();
+void split::ofstream::settle_file_sizes() {
+    std::error_code ec;
+    if (options.compression == Compression::none && max_filesize != UINT64_MAX) {
+        // Seeking past the end skips over files or parts of them, every file but the last is max_filesize
+        // long with holes where nothing was written
+        for (std::size_t i = 0; i + 1 < outfiles.size(); ++i) {
+            uint64_t size = std::filesystem::file_size(outfiles[i].path, ec);
+            if (!ec && size < max_filesize && !detail::resize_file(outfiles[i].path, max_filesize)) {
+                io_failed = true;
+            }
+        }
+    }
+    if (options.preallocate && !outfiles.empty()) {
+        // Cutting the last file to its own size frees the space reserved past its end
+        uint64_t size = std::filesystem::file_size(outfiles.back().path, ec);
+        if (!ec) {
+            detail::resize_file(outfiles.back().path, size);
+        }
+    }
+}
+
+void split::ofstream::stop_write_behind() {
+    if (!write_behind) {
+        return;
+    }
+    if (!write_behind->flush()) {
+        io_failed = true;
+    }
+    write_behind.reset();
+}
+
+void split::ofstream::start_compression() {
+    if (options.frame_size == 0 || options.frame_size > UINT32_MAX || max_filesize < options.frame_size) {
+        throw std::invalid_argument("Compressed files need room for at least one frame");
+    }
+    unsigned int threads = options.compression_threads > 0 ? options.compression_threads : std::thread::hardware_concurrency();
+    pool = std::make_unique<detail::ThreadPool>(threads);
+    // Checksums would follow the data before compression, which isn't what ends up in the files
+    checksums_valid = false;
+}
+
+void split::ofstream::write_compressed(const char* _Str, uint64_t _Count) {
+    current_position += _Count;
+    while (_Count > 0) {
+        if (!filling_frame) {
+            if (spare_frames.empty()) {
+                filling_frame = std::make_unique<PendingFrame>();
+                filling_frame->input.reserve(options.frame_size);
+            } else {
+                filling_frame = std::move(spare_frames.back());
+                spare_frames.pop_back();
+                filling_frame->input.clear();
+            }
+        }
+
+        std::vector<char>& input = filling_frame->input;
+        uint64_t take = std::min<uint64_t>(_Count, options.frame_size - input.size());
+        input.insert(input.end(), _Str, _Str + take);
+        _Str += take;
+        _Count -= take;
+        if (input.size() == options.frame_size) {
+            submit_frame();
+        }
+    }
+}
+
+void split::ofstream::submit_frame() {
+    PendingFrame* frame = filling_frame.get();
+    frame->done = pool->submit([frame] {
+        // Only worth keeping if it's smaller, the capacity leaves no room for anything else
+        std::size_t size = frame->input.size();
+        frame->output.resize(detail::lz4_bound(size));
+        frame->output_size = detail::lz4_compress(frame->input.data(), size, frame->output.data(), std::min(frame->output.size(), size - 1));
+    });
+    pending_frames.push_back(std::move(filling_frame));
+    drain_frames(false);
+}
+
+void split::ofstream::drain_frames(bool _All) {
+    // Frames go out in order, so a slow one holds up those behind it. A couple of frames per thread in
+    // flight keeps every thread busy without piling up memory.
+    std::size_t max_pending = pool ? pool->size() * 2 : 0;
+    while (!pending_frames.empty()) {
+        PendingFrame& frame = *pending_frames.front();
+        if (!_All && pending_frames.size() <= max_pending && frame.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            break;
+        }
+        frame.done.get();
+        store_frame(frame);
+        spare_frames.push_back(std::move(pending_frames.front()));
+        pending_frames.pop_front();
+    }
+}
+
+void split::ofstream::store_frame(PendingFrame &_Frame) {
+    bool compressed = _Frame.output_size > 0;
+    const char* data = compressed ? _Frame.output.data() : _Frame.input.data();
+    uint64_t size = compressed ? _Frame.output_size : _Frame.input.size();
+
+    // Frames never straddle files, so each file can be read on its own
+    if (compressed_end + size > max_filesize) {
+        open_new_stream();
+        compressed_end = 0;
+    }
+    unsigned int index = static_cast<unsigned int>(outfiles.size() - 1);
+    int fd = files->get(index);
+    if (fd < 0 || detail::pwrite_all(fd, data, size, compressed_end) != size) {
+        io_failed = true;
+    }
+    recorder.transfer(index, size);
+
+    frames.push_back({ index, compressed_end, static_cast<uint32_t>(size), static_cast<uint32_t>(_Frame.input.size()), compressed });
+    compressed_end += size;
+}
+
+void split::ofstream::update_checksums(uint64_t _Off, const char* _Str, uint64_t _Count) {
+    if (!checksums_valid) {
+        return;
+    }
+    if (_Off != checksummed_until) {
+        // Going back over data that's already been checksummed
+        checksums_valid = false;
+        return;
+    }
+
+    while (_Count > 0) {
+        unsigned int index = static_cast<unsigned int>(_Off / max_filesize);
+        uint64_t length = std::min(_Count, max_filesize - (_Off - max_filesize * index));
+        if (index >= checksums.size()) {
+            checksums.resize(index + 1, 0);
+        }
+        checksums[index] = detail::crc32c(checksums[index], _Str, static_cast<std::size_t>(length));
+        _Off += length;
+        _Str += length;
+        _Count -= length;
+    }
+    checksummed_until = _Off;
+}
+
+bool split::ofstream::checksums_complete() const {
+    // Every byte of every file went through the checksums, and made it into the files
+    return checksums_valid && !fail() && checksummed_until >= max_filesize * (outfiles.size() - 1);
+}
+
+void split::ofstream::write_checksums() {
+    std::filesystem::path checksum_path = parent_path / (file_stem + file_ext + ".crc32c");
+    uint64_t last_offset = max_filesize * (outfiles.size() - 1);
+    if (!checksums_complete()) {
+        // Don't leave checksums from an earlier run next to the new files
+        std::error_code ec;
+        std::filesystem::remove(checksum_path, ec);
+        return;
+    }
+    checksums.resize(outfiles.size(), 0);
+
+    std::vector<detail::ChecksumEntry> entries;
+    entries.push_back({ 0, checksummed_until, file_stem + file_ext });
+    for (std::size_t i = 0; i < outfiles.size(); ++i) {
+        uint64_t size = (i + 1 < outfiles.size()) ? max_filesize : checksummed_until - last_offset;
+        entries.push_back({ checksums[i], size, outfiles[i].path.filename().string() });
+        entries[0].crc = detail::crc32c_combine(entries[0].crc, checksums[i], size);
+    }
+    if (!detail::write_checksum_file(checksum_path, entries)) {
+        io_failed = true;
+    }
+}
+
+void split::ofstream::write_manifest() {
+    Manifest manifest;
+    manifest.has_checksums = checksums_complete();
+    checksums.resize(outfiles.size(), 0);
+    uint64_t offset = 0;
+
+    // Compressed files hold exactly the frames stored in them
+    std::vector<uint64_t> frame_ends;
+    if (options.compression != Compression::none) {
+        manifest.compression = options.compression;
+        manifest.frame_size = options.frame_size;
+        manifest.frames = frames;
+        frame_ends.assign(outfiles.size(), 0);
+        for (const auto& frame : frames) {
+            frame_ends[frame.segment] = std::max(frame_ends[frame.segment], frame.offset + frame.stored_size);
+        }
+    }
+
+    for (std::size_t i = 0; i < outfiles.size(); ++i) {
+        Manifest::Segment segment;
+        segment.path = outfiles[i].path;
+        segment.offset = offset;
+        if (!frame_ends.empty()) {
+            segment.size = frame_ends[i];
+        } else if (manifest.has_checksums) {
+            // Written in order, so only the last file can be short
+            segment.size = (i + 1 < outfiles.size()) ? max_filesize : checksummed_until - offset;
+            segment.crc32c = checksums[i];
+        } else {
+            std::error_code ec;
+            segment.size = std::filesystem::file_size(segment.path, ec);
+            if (ec) {
+                io_failed = true;
+                return;
+            }
         }
+        offset += segment.size;
+        manifest.segments.push_back(std::move(segment));
+    }
+
+    std::filesystem::path manifest_path = parent_path / (file_stem + file_ext + ".manifest");
+    if (!options.publish_on_close) {
+        if (!manifest.save(manifest_path)) {
+            io_failed = true;
+        }
+        return;
+    }
+
+    // Readers take the manifest as the sign the files are ready, so it has to appear all at once
+    std::filesystem::path temp_path = parent_path / ("." + file_stem + file_ext + ".manifest.part");
+    std::error_code ec;
+    if (!manifest.save(temp_path)) {
+        io_failed = true;
+        std::filesystem::remove(temp_path, ec);
+        return;
+    }
+    std::filesystem::rename(temp_path, manifest_path, ec);
+    if (ec) {
+        io_failed = true;
     }
+}
+
+void split::ofstream::clean_all() {
+    close_stream();
+    detail::close_fd(direct_fd);
+    direct_fd = -1;
+    direct_fd_stream = -1;
+    direct_buffer.reset();
+    direct_begin = direct_end = 0;
+    write_behind.reset();
     outfiles.clear();
+    pool.reset();
+    ring.reset();
+    files.reset();
+    files_mutex.reset();
     current_stream = 0;
     current_position = 0;
     max_filesize = UINT64_MAX;
+    io_failed = false;
+    seek_pending = false;
+    checksums.clear();
+    checksummed_until = 0;
+    checksums_valid = false;
+    filling_frame.reset();
+    pending_frames.clear();
+    spare_frames.clear();
+    frames.clear();
+    compressed_end = 0;
     parent_path.clear();
     file_stem.clear();
     file_ext.clear();
 }
 
+unsigned int split::ofstream::find_stream(uint64_t _Off) const {
+    // Every stream but the last is exactly max_filesize long, a position on a boundary belongs to the end of the earlier stream
+    uint64_t index = (_Off == 0) ? 0 : (_Off - 1) / max_filesize;
+    return static_cast<unsigned int>(std::min<uint64_t>(index, outfiles.size() - 1));
+}
+
+void split::ofstream::open_stream(unsigned int _Index) {
+    if (active_stream == static_cast<int>(_Index)) {
+        return;
+    }
+    close_stream();
+
+    uint64_t start = recorder.start();
+    StreamInfo& file = outfiles[_Index];
+    if (options.buffer_size > 0) {
+        // Has to be set before opening, the buffer goes back to the pool when the file is closed
+        file.buffer = detail::BufferPool::instance().acquire(options.buffer_size);
+        file.stream.rdbuf()->pubsetbuf(file.buffer.data(), static_cast<std::streamsize>(file.buffer.size()));
+    }
+    // The file already exists, opening for in|out keeps what's been written to it
+    file.stream.open(file.path, std::ios::in | std::ios::out | std::ios::binary);
+    active_stream = static_cast<int>(_Index);
+    recorder.opened(_Index, start);
+}
+
+void split::ofstream::close_stream() {
+    if (active_stream < 0) {
+        return;
+    }
+    uint64_t start = recorder.start();
+    StreamInfo& file = outfiles[active_stream];
+    file.stream.close();
+    if (file.stream.fail()) {
+        // The last of the buffer didn't make it to the file
+        io_failed = true;
+    }
+    file.buffer.reset();
+    recorder.closed(static_cast<unsigned int>(active_stream), start);
+    active_stream = -1;
+}
+
 std::filesystem::path split::ofstream::get_next_filepath() {
-    return parent_path / (file_stem + "." + std::to_string(current_stream + 1) + file_ext);
+    unsigned int index = static_cast<unsigned int>(outfiles.size());
+    if (options.publish_on_close) {
+        // Hidden until close() gives it its final name
+        return parent_path / ("." + file_stem + "." + std::to_string(index + 1) + file_ext + ".part");
+    }
+    if (options.name_digits > 0 || options.expected_size > 0) {
+        return final_path(index, std::max<std::size_t>(expected_files(), index + 1));
+    }
+    return parent_path / (file_stem + "." + std::to_string(index + 1) + file_ext);
+}
+
+std::filesystem::path split::ofstream::final_path(unsigned int _Index, std::size_t _Count) {
+    int count = static_cast<int>(_Count);
+    if (options.name_digits > 0 && num_digits(count) <= static_cast<int>(options.name_digits)) {
+        return parent_path / (file_stem + "." + pad_digits(_Index + 1, static_cast<int>(options.name_digits)) + file_ext);
+    }
+    if (_Count == 1) {
+        return parent_path / (file_stem + file_ext);
+    }
+    int width = (_Count < 10) ? 1 : num_digits(count);
+    return parent_path / (file_stem + "." + pad_digits(_Index + 1, width) + file_ext);
+}
+
+std::size_t split::ofstream::expected_files() const {
+    if (options.expected_size == 0 || max_filesize == UINT64_MAX) {
+        return 1;
+    }
+    return static_cast<std::size_t>(std::max<uint64_t>((options.expected_size + max_filesize - 1) / max_filesize, 1));
 }
 
 void split::ofstream::open_new_stream() {
     std::filesystem::path filepath = get_next_filepath();
-    outfiles.push_back({ std::ofstream(filepath, std::ios::binary), filepath, current_stream });
-}
+    unsigned int index = static_cast<unsigned int>(outfiles.size());
+    outfiles.emplace_back();
+    outfiles.back().path = filepath;
+    outfiles.back().index = index;
 
-void split::ofstream::rename_output_files() {
-    if (outfiles.size() > 1 && outfiles.size() < 10) {
-        return;
-    } else if (outfiles.size() == 1) {
-        try {
-            std::filesystem::rename(outfiles[0].path, parent_path / (file_stem + file_ext));
-            outfiles[0].path = parent_path / (file_stem + file_ext);
-        } catch (const std::exception& e) {
-            std::cerr << "Error: " << e.what() << std::endl;
-        }
-        return;
+    // The stream is opened once it's written to, only the file is created here
+    uint64_t reserve = (options.preallocate && max_filesize != UINT64_MAX) ? max_filesize : 0;
+    if (!detail::create_file(filepath, reserve)) {
+        outfiles.back().stream.setstate(std::ios::failbit);
     }
 
-    int digits = num_digits(static_cast<int>(outfiles.size()));
+    if (!files) {
+        files = std::make_unique<detail::FileTable>(detail::FileTable::Access::write);
+        files_mutex = std::make_unique<std::mutex>();
+    }
+    files->add(filepath);
+}
 
+void split::ofstream::rename_output_files() {
+    // Only files whose name doesn't match the final number of files are renamed, none when the names were
+    // settled up front
     for (auto& file : outfiles) {
-        if (!std::filesystem::exists(file.path)) {
+        std::filesystem::path new_path = final_path(file.index, outfiles.size());
+        if (file.path == new_path || !std::filesystem::exists(file.path)) {
             continue;
         }
 
         bool err = false;
-        std::filesystem::path new_path = parent_path / (file_stem + "." + pad_digits(file.index + 1, digits) + file_ext);
-
         try {
             std::filesystem::rename(file.path, new_path);
         } catch (const std::exception& e) {
@@ -233,6 +1141,27 @@ split::PathsWrapper split::ofstream::paths() const {
     return PathsWrapper(paths);
 }
 
+std::vector<std::filesystem::path> split::split_file(const std::filesystem::path &_Src, const std::filesystem::path &_Path, uint64_t _Maxsize, const WriteOptions &_Options, unsigned int _Threads) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(_Src, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to open file: " + _Src.string());
+    }
+
+    // The size is known, so the files get their final names right away
+    WriteOptions options = _Options;
+    if (options.expected_size == 0) {
+        options.expected_size = size;
+    }
+    ofstream fout(_Path, _Maxsize, options);
+    fout.write_file(_Src, _Threads);
+    fout.close();
+    if (fout.fail()) {
+        throw std::runtime_error("Failed to split file: " + _Src.string());
+    }
+    return fout.paths();
+}
+
 std::vector<std::string> split::PathsWrapper::string() const {
     std::vector<std::string> str_paths;
     str_paths.reserve(paths_.size());
@@ -0,0 +1,61 @@
+#include <fcntl.h>
+
+#include "split_prefetcher.h"
+
+split::detail::Prefetcher::Prefetcher(FileTable &_Files)
+    :   files(&_Files) {
+    worker = std::thread(&Prefetcher::run, this);
+}
+
+split::detail::Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        pending.clear();
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void split::detail::Prefetcher::request(std::vector<Range> _Ranges) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The reader has moved on, anything still queued is behind it
+        pending.clear();
+        for (auto& range : _Ranges) {
+            pending.push_back(std::move(range));
+        }
+    }
+    wake.notify_one();
+}
+
+void split::detail::Prefetcher::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait(lock, [this] { return stopping || !pending.empty(); });
+        if (stopping) {
+            return;
+        }
+
+        Range range = std::move(pending.front());
+        pending.pop_front();
+
+        lock.unlock();
+        advise(range);
+        lock.lock();
+    }
+}
+
+void split::detail::Prefetcher::advise(const Range &_Range) {
+    // Held only for the hint, so the descriptor can be closed to make room once it's idle
+    FileTable::Handle file = files->acquire(_Range.file);
+    if (file.fd() < 0) {
+        // Prefetching is only a hint, the reader reports the error when it gets there
+        return;
+    }
+
+#if defined(POSIX_FADV_WILLNEED)
+    ::posix_fadvise(file.fd(), static_cast<off_t>(_Range.offset), static_cast<off_t>(_Range.length), POSIX_FADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,50 @@
+#ifndef _SPLIT_PREFETCHER_H_
+#define _SPLIT_PREFETCHER_H_
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "split_file.h"
+
+namespace split {
+namespace detail {
+
+// Background thread asking the kernel to read ranges of files into the page cache ahead of the reader.
+// Descriptors come from the reader's FileTable, so they count towards its limit.
+class Prefetcher {
+public:
+    struct Range {
+        // Index of the file in the table
+        unsigned int file;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    explicit Prefetcher(FileTable &_Files);
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+    ~Prefetcher();
+
+    // Queues the ranges and returns immediately, older ranges that haven't been started yet are dropped
+    void request(std::vector<Range> _Ranges);
+
+private:
+    void run();
+    void advise(const Range &_Range);
+
+    FileTable* files;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Range> pending;
+    bool stopping{false};
+};
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_PREFETCHER_H_
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+
+#include "split_read_ahead.h"
+
+split::detail::ReadAhead::ReadAhead(ReadFunction _Read, uint64_t _Start, uint64_t _End, std::size_t _Chunk, unsigned int _Threads)
+    :   read_function(std::move(_Read)),
+        start(_Start),
+        end(_End),
+        chunk_size(std::max<std::size_t>(_Chunk, 1)),
+        read_position(_Start) {
+    // Two slots per thread, so a thread finishing a chunk finds a free slot while the reader works on another
+    _Threads = std::max(_Threads, 1u);
+    slot_count = std::size_t(_Threads) * 2;
+    slots = std::make_unique<Slot[]>(slot_count);
+    for (std::size_t i = 0; i < slot_count; ++i) {
+        slots[i].sequence.store(2 * i, std::memory_order_relaxed);
+        slots[i].buffer = BufferPool::instance().acquire(chunk_size);
+    }
+
+    workers.reserve(_Threads);
+    for (unsigned int i = 0; i < _Threads; ++i) {
+        workers.emplace_back(&ReadAhead::run, this);
+    }
+}
+
+split::detail::ReadAhead::~ReadAhead() {
+    stopping = true;
+    for (std::size_t i = 0; i < slot_count; ++i) {
+        // Under the mutex, so a thread that missed stopping is already asleep to be woken
+        std::lock_guard<std::mutex> lock(slots[i].mutex);
+        slots[i].wake.notify_all();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+uint64_t split::detail::ReadAhead::chunk_begin(uint64_t _Chunk) const {
+    // The first chunk is cut short so the rest start on a multiple of chunk_size, the same frames or file
+    // boundaries a chunk size that divides them lines up with
+    uint64_t begin = (start / chunk_size + _Chunk) * chunk_size;
+    return std::min(std::max(begin, start), end);
+}
+
+bool split::detail::ReadAhead::wait_for(Slot &_Slot, uint64_t _Value) {
+    // Spin briefly since the other side is usually close, then sleep to not burn a core while a thread
+    // waits on the disk or the reader on its consumer
+    for (unsigned int spins = 0; spins < 1024; ++spins) {
+        if (_Slot.sequence.load(std::memory_order_acquire) == _Value) {
+            return true;
+        }
+        if (stopping.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (spins >= 64) {
+            std::this_thread::yield();
+        }
+    }
+
+    // Counted before the sequence is checked again and the other side stores it before checking the
+    // count, so one of the two sees the other
+    std::unique_lock<std::mutex> lock(_Slot.mutex);
+    _Slot.waiters.fetch_add(1);
+    _Slot.wake.wait(lock, [&] { return _Slot.sequence.load() == _Value || stopping.load(); });
+    _Slot.waiters.fetch_sub(1);
+    return _Slot.sequence.load() == _Value;
+}
+
+void split::detail::ReadAhead::publish(Slot &_Slot, uint64_t _Value) {
+    _Slot.sequence.store(_Value);
+    if (_Slot.waiters.load() > 0) {
+        std::lock_guard<std::mutex> lock(_Slot.mutex);
+        _Slot.wake.notify_all();
+    }
+}
+
+void split::detail::ReadAhead::run() {
+    while (!stopping.load(std::memory_order_relaxed)) {
+        uint64_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+        uint64_t begin = chunk_begin(chunk);
+        if (begin >= end) {
+            return;
+        }
+
+        Slot& slot = slots[chunk % slot_count];
+        if (!wait_for(slot, 2 * chunk)) {
+            return;
+        }
+        slot.size = read_function(begin, slot.buffer.data(), chunk_begin(chunk + 1) - begin);
+        publish(slot, 2 * chunk + 1);
+    }
+}
+
+uint64_t split::detail::ReadAhead::read(char* _Str, uint64_t _Count) {
+    uint64_t copied = 0;
+    while (copied < _Count && read_position < end) {
+        Slot& slot = slots[read_chunk % slot_count];
+        if (!wait_for(slot, 2 * read_chunk + 1)) {
+            break;
+        }
+
+        uint64_t pos_in_chunk = read_position - chunk_begin(read_chunk);
+        if (pos_in_chunk >= slot.size) {
+            // The chunk came back short, the read position stays where the data ran out
+            break;
+        }
+        uint64_t take = std::min(_Count - copied, slot.size - pos_in_chunk);
+        std::memcpy(_Str + copied, slot.buffer.data() + pos_in_chunk, static_cast<std::size_t>(take));
+        copied += take;
+        read_position += take;
+
+        if (read_position == chunk_begin(read_chunk + 1)) {
+            // Done with the slot, it's free for the chunk a whole ring later
+            publish(slot, 2 * (read_chunk + slot_count));
+            ++read_chunk;
+        }
+    }
+    return copied;
+}
@@ -0,0 +1,75 @@
+#ifndef _SPLIT_READ_AHEAD_H_
+#define _SPLIT_READ_AHEAD_H_
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "split_buffer_pool.h"
+
+namespace split {
+namespace detail {
+
+// Reads [_Start, _End) of a stream on several threads ahead of one sequential reader. The range is cut
+// into chunks on multiples of _Chunk, each thread claims the next chunk and reads it into a ring of
+// slots, and the reader takes them back in order. Slots are handed over with sequence numbers instead
+// of locks: slot i % slots is free for chunk i at 2 * i and holds it at 2 * i + 1. Only a side that has
+// waited for a while sleeps on the slot's condition variable.
+class ReadAhead {
+public:
+    // Positional read of the stream, called from the threads at once
+    using ReadFunction = std::function<uint64_t(uint64_t _Off, char* _Str, uint64_t _Count)>;
+
+    ReadAhead(ReadFunction _Read, uint64_t _Start, uint64_t _End, std::size_t _Chunk, unsigned int _Threads);
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+    ~ReadAhead();
+
+    // Copies up to _Count bytes from the read position, waiting for the threads when they're behind.
+    // Returns the number of bytes copied, short at the end of the range or where a chunk couldn't be read.
+    uint64_t read(char* _Str, uint64_t _Count);
+    uint64_t position() const { return read_position; }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        PooledBuffer buffer;
+        uint64_t size{0};
+        // Threads asleep on wake, so the other side only takes the mutex when someone is
+        std::atomic<unsigned int> waiters{0};
+        std::mutex mutex;
+        std::condition_variable wake;
+    };
+
+    void run();
+    uint64_t chunk_begin(uint64_t _Chunk) const;
+    // Waits until the slot's sequence holds _Value, false if stopped first
+    bool wait_for(Slot &_Slot, uint64_t _Value);
+    // Hands the slot over to the other side, waking it if it's asleep
+    void publish(Slot &_Slot, uint64_t _Value);
+
+    ReadFunction read_function;
+    uint64_t start;
+    uint64_t end;
+    std::size_t chunk_size;
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t slot_count;
+    std::atomic<uint64_t> next_chunk{0};
+    std::atomic<bool> stopping{false};
+    std::vector<std::thread> workers;
+
+    // Only touched by the reader
+    uint64_t read_chunk{0};
+    uint64_t read_position;
+};
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_READ_AHEAD_H_
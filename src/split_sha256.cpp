@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#include "split_sha256.h"
+#include "split_file.h"
+#include "split_buffer_pool.h"
+#include "split_thread_pool.h"
+
+namespace {
+
+alignas(16) constexpr uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t rotr(uint32_t x, uint32_t n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void transform_scalar(uint32_t* _State, const uint8_t* _Data, std::size_t _Blocks) {
+    for (; _Blocks > 0; --_Blocks, _Data += 64) {
+        uint32_t m[64];
+        for (uint32_t i = 0, j = 0; i < 16; ++i, j += 4) {
+            m[i] = (uint32_t(_Data[j]) << 24) | (uint32_t(_Data[j + 1]) << 16) | (uint32_t(_Data[j + 2]) << 8) | uint32_t(_Data[j + 3]);
+        }
+        for (uint32_t i = 16; i < 64; ++i) {
+            uint32_t delta0 = rotr(m[i - 15], 7) ^ rotr(m[i - 15], 18) ^ (m[i - 15] >> 3);
+            uint32_t delta1 = rotr(m[i - 2], 17) ^ rotr(m[i - 2], 19) ^ (m[i - 2] >> 10);
+            m[i] = delta1 + m[i - 7] + delta0 + m[i - 16];
+        }
+
+        uint32_t a = _State[0], b = _State[1], c = _State[2], d = _State[3];
+        uint32_t e = _State[4], f = _State[5], g = _State[6], h = _State[7];
+
+        for (uint32_t i = 0; i < 64; ++i) {
+            uint32_t sigma1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + sigma1 + choice + k[i] + m[i];
+            uint32_t sigma0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = sigma0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        _State[0] += a;
+        _State[1] += b;
+        _State[2] += c;
+        _State[3] += d;
+        _State[4] += e;
+        _State[5] += f;
+        _State[6] += g;
+        _State[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+// The SHA extensions keep the state as ABEF/CDGH and do two rounds per instruction. Message words live
+// in w[] four at a time, each group of four rounds finishes the schedule for a later group.
+__attribute__((target("sha,sse4.1,ssse3")))
+void transform_shani(uint32_t* _State, const uint8_t* _Data, std::size_t _Blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&_State[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&_State[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; _Blocks > 0; --_Blocks, _Data += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i w[4];
+
+        for (int i = 0; i < 16; ++i) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_Data + 16 * i)), byte_swap);
+            }
+            __m128i msg = _mm_add_epi32(w[i & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(&k[4 * i])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (i >= 3 && i <= 14) {
+                __m128i next = _mm_add_epi32(w[(i + 1) & 3], _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4));
+                w[(i + 1) & 3] = _mm_sha256msg2_epu32(next, w[i & 3]);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+            if (i >= 1 && i <= 12) {
+                w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&_State[0]), _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&_State[4]), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+bool has_sha_extensions() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+#endif
+
+using TransformFunction = void (*)(uint32_t*, const uint8_t*, std::size_t);
+
+TransformFunction select_transform() {
+#if defined(__x86_64__)
+    if (has_sha_extensions()) {
+        return transform_shani;
+    }
+#endif
+    return transform_scalar;
+}
+
+void transform(uint32_t* _State, const uint8_t* _Data, std::size_t _Blocks) {
+    static const TransformFunction function = select_transform();
+    function(_State, _Data, _Blocks);
+}
+
+}; // namespace
+
+void split::Sha256::reset() {
+    static constexpr uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(state, initial, sizeof(state));
+    block_size = 0;
+    length = 0;
+}
+
+void split::Sha256::update(const void* _Data, std::size_t _Size) {
+    const uint8_t* data = static_cast<const uint8_t*>(_Data);
+    length += _Size;
+
+    // Top up a partial block first
+    if (block_size > 0) {
+        std::size_t take = std::min(_Size, sizeof(block) - block_size);
+        std::memcpy(block + block_size, data, take);
+        block_size += take;
+        data += take;
+        _Size -= take;
+        if (block_size < sizeof(block)) {
+            return;
+        }
+        transform(state, block, 1);
+        block_size = 0;
+    }
+
+    // Then every whole block in place, without copying
+    std::size_t blocks = _Size / 64;
+    if (blocks > 0) {
+        transform(state, data, blocks);
+        data += blocks * 64;
+        _Size -= blocks * 64;
+    }
+
+    std::memcpy(block, data, _Size);
+    block_size = _Size;
+}
+
+split::Sha256::Digest split::Sha256::finish() {
+    uint64_t bit_length = length * 8;
+
+    // 0x80, zeros up to 56 mod 64, then the length in bits, big endian
+    uint8_t padding[72] = { 0x80 };
+    std::size_t padding_size = (block_size < 56) ? 56 - block_size : 120 - block_size;
+    for (int i = 0; i < 8; ++i) {
+        padding[padding_size + i] = static_cast<uint8_t>(bit_length >> (56 - 8 * i));
+    }
+    update(padding, padding_size + 8);
+
+    Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+        digest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+        digest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+        digest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+    }
+    reset();
+    return digest;
+}
+
+std::string split::Sha256::to_hex(const Digest &_Digest) {
+    std::ostringstream oss;
+    for (uint8_t byte : _Digest) {
+        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+    }
+    return oss.str();
+}
+
+split::Sha256::Digest split::sha256_file(const std::filesystem::path &_Path) {
+    int fd = ::open(_Path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + _Path.string());
+    }
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Big reads keep the syscall count down, the hash itself is the slow part
+    detail::PooledBuffer buffer = detail::BufferPool::instance().acquire(1024 * 1024 * 4);
+    Sha256 sha256;
+    uint64_t offset = 0;
+    for (;;) {
+        ssize_t got = ::pread(fd, buffer.data(), buffer.size(), static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            detail::close_fd(fd);
+            throw std::runtime_error("Could not read file: " + _Path.string());
+        }
+        if (got == 0) {
+            break;
+        }
+        sha256.update(buffer.data(), static_cast<std::size_t>(got));
+        offset += static_cast<uint64_t>(got);
+    }
+    detail::close_fd(fd);
+    return sha256.finish();
+}
+
+std::vector<split::Sha256::Digest> split::sha256_files(const std::vector<std::filesystem::path> &_Paths, unsigned int _Threads) {
+    std::vector<Sha256::Digest> digests(_Paths.size());
+    if (_Threads == 0) {
+        _Threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    _Threads = std::min<unsigned int>(_Threads, static_cast<unsigned int>(_Paths.size()));
+    if (_Threads <= 1) {
+        for (std::size_t i = 0; i < _Paths.size(); ++i) {
+            digests[i] = sha256_file(_Paths[i]);
+        }
+        return digests;
+    }
+
+    // One file per task, the first error is rethrown once they've all finished
+    detail::ThreadPool pool(_Threads);
+    std::vector<std::future<void>> pending;
+    pending.reserve(_Paths.size());
+    for (std::size_t i = 0; i < _Paths.size(); ++i) {
+        pending.push_back(pool.submit([&, i] { digests[i] = sha256_file(_Paths[i]); }));
+    }
+    std::exception_ptr error;
+    for (auto& task : pending) {
+        try {
+            task.get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return digests;
+}
@@ -0,0 +1,43 @@
+#ifndef _SPLIT_SHA256_H_
+#define _SPLIT_SHA256_H_
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+namespace split {
+
+// Incremental SHA-256. Whole blocks are hashed straight from the caller's buffer, with the x86 SHA
+// extensions when the CPU has them.
+class Sha256 {
+public:
+    using Digest = std::array<uint8_t, 32>;
+
+    Sha256() { reset(); }
+
+    void update(const void* _Data, std::size_t _Size);
+    // Digest of everything passed to update() since the last reset, the hash starts over afterwards
+    Digest finish();
+    void reset();
+
+    static std::string to_hex(const Digest &_Digest);
+
+private:
+    uint32_t state[8];
+    uint8_t block[64];
+    std::size_t block_size;
+    uint64_t length;
+};
+
+// Digest of a whole file, read in large blocks. Throws if the file can't be read.
+Sha256::Digest sha256_file(const std::filesystem::path &_Path);
+
+// Digest of each file on its own, hashing up to _Threads files at once (0 uses every core)
+std::vector<Sha256::Digest> sha256_files(const std::vector<std::filesystem::path> &_Paths, unsigned int _Threads = 0);
+
+}; // namespace split
+
+#endif // _SPLIT_SHA256_H_
@@ -0,0 +1,147 @@
+#ifndef _SPLIT_STATS_H_
+#define _SPLIT_STATS_H_
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+// Statistics are compiled in with -DSPLIT_FSTREAM_STATS=1 (CMake option SPLIT_FSTREAM_STATS). Without it
+// every recording call is an empty inline function, stats() stays zeroed and trace hooks are never called.
+#ifndef SPLIT_FSTREAM_STATS
+#define SPLIT_FSTREAM_STATS 0
+#endif
+
+namespace split {
+
+struct SegmentStats {
+    uint64_t bytes{0};
+    uint64_t ops{0};
+};
+
+struct IoStats {
+    // read()/write()/readv()/writev() calls and the bytes they moved
+    uint64_t ops{0};
+    uint64_t bytes{0};
+    // Calls whose data spanned more than one file
+    uint64_t boundary_crossings{0};
+    uint64_t seeks{0};
+    uint64_t segment_opens{0};
+    uint64_t segment_closes{0};
+    uint64_t open_ns{0};
+    uint64_t close_ns{0};
+    // split::ofstream only, time spent renaming files at close()
+    uint64_t rename_ns{0};
+    // Indexed by file
+    std::vector<SegmentStats> segments;
+};
+
+enum class TraceEvent { open, close, seek, transfer, rename };
+
+struct TraceRecord {
+    TraceEvent event;
+    // File the event concerns, 0 for seek and rename
+    unsigned int segment;
+    // Stream position for seek and transfer
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t duration_ns;
+};
+
+using TraceHook = std::function<void(const TraceRecord&)>;
+
+namespace detail {
+
+#if SPLIT_FSTREAM_STATS
+
+class StatsRecorder {
+public:
+    uint64_t start() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void transfer(unsigned int _Segment, uint64_t _Bytes) {
+        SegmentStats& segment = segment_stats(_Segment);
+        segment.bytes += _Bytes;
+        segment.ops++;
+    }
+
+    void op(uint64_t _Offset, uint64_t _Bytes, bool _Crossed, uint64_t _Start) {
+        stats.ops++;
+        stats.bytes += _Bytes;
+        stats.boundary_crossings += _Crossed ? 1 : 0;
+        trace(TraceEvent::transfer, 0, _Offset, _Bytes, _Start);
+    }
+
+    void seek(uint64_t _Offset) {
+        stats.seeks++;
+        if (hook) {
+            hook({ TraceEvent::seek, 0, _Offset, 0, 0 });
+        }
+    }
+
+    void opened(unsigned int _Segment, uint64_t _Start) {
+        stats.segment_opens++;
+        stats.open_ns += trace(TraceEvent::open, _Segment, 0, 0, _Start);
+    }
+
+    void closed(unsigned int _Segment, uint64_t _Start) {
+        stats.segment_closes++;
+        stats.close_ns += trace(TraceEvent::close, _Segment, 0, 0, _Start);
+    }
+
+    void renamed(uint64_t _Start) {
+        stats.rename_ns += trace(TraceEvent::rename, 0, 0, 0, _Start);
+    }
+
+    const IoStats& get() const { return stats; }
+    void reset() { stats = IoStats(); }
+    void set_hook(TraceHook _Hook) { hook = std::move(_Hook); }
+
+private:
+    SegmentStats& segment_stats(unsigned int _Segment) {
+        if (_Segment >= stats.segments.size()) {
+            stats.segments.resize(_Segment + 1);
+        }
+        return stats.segments[_Segment];
+    }
+
+    uint64_t trace(TraceEvent _Event, unsigned int _Segment, uint64_t _Offset, uint64_t _Bytes, uint64_t _Start) {
+        uint64_t duration = start() - _Start;
+        if (hook) {
+            hook({ _Event, _Segment, _Offset, _Bytes, duration });
+        }
+        return duration;
+    }
+
+    IoStats stats;
+    TraceHook hook;
+};
+
+#else
+
+class StatsRecorder {
+public:
+    uint64_t start() const { return 0; }
+    void transfer(unsigned int, uint64_t) {}
+    void op(uint64_t, uint64_t, bool, uint64_t) {}
+    void seek(uint64_t) {}
+    void opened(unsigned int, uint64_t) {}
+    void closed(unsigned int, uint64_t) {}
+    void renamed(uint64_t) {}
+
+    const IoStats& get() const {
+        static const IoStats empty;
+        return empty;
+    }
+    void reset() {}
+    void set_hook(TraceHook) {}
+};
+
+#endif
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_STATS_H_
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "split_thread_pool.h"
+
+split::detail::ThreadPool::ThreadPool(unsigned int _Threads) {
+    _Threads = std::max(_Threads, 1u);
+    workers.reserve(_Threads);
+    for (unsigned int i = 0; i < _Threads; ++i) {
+        workers.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+split::detail::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+std::future<void> split::detail::ThreadPool::submit(std::function<void()> _Task) {
+    std::packaged_task<void()> task(std::move(_Task));
+    std::future<void> result = task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+    return result;
+}
+
+void split::detail::ThreadPool::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+        // Tasks already queued still run, their futures are being waited on
+        if (tasks.empty()) {
+            return;
+        }
+
+        std::packaged_task<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
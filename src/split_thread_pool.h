@@ -0,0 +1,39 @@
+#ifndef _SPLIT_THREAD_POOL_H_
+#define _SPLIT_THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+namespace split {
+namespace detail {
+
+// Fixed set of worker threads running tasks in submission order
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int _Threads);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    std::future<void> submit(std::function<void()> _Task);
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+private:
+    void run();
+
+    std::vector<std::thread> workers;
+    std::deque<std::packaged_task<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping{false};
+};
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_THREAD_POOL_H_
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cstring>
+
+#include "split_write_behind.h"
+
+split::detail::WriteBehind::WriteBehind(Sink _Sink, std::size_t _Buffer_size, unsigned int _Buffers)
+    :   sink(std::move(_Sink)) {
+    // Two at least, one filling while the other is written
+    buffers.resize(std::max(_Buffers, 2u));
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+        buffers[i].data = BufferPool::instance().acquire(std::max<std::size_t>(_Buffer_size, 1));
+        free_buffers.push_back(i);
+    }
+    worker = std::thread(&WriteBehind::run, this);
+}
+
+split::detail::WriteBehind::~WriteBehind() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work.notify_one();
+    worker.join();
+}
+
+void split::detail::WriteBehind::write(uint64_t _Off, const char* _Str, std::size_t _Count) {
+    while (_Count > 0) {
+        if (current != SIZE_MAX) {
+            Buffer& buffer = buffers[current];
+            if (buffer.offset + buffer.size != _Off || buffer.size == buffer.data.size()) {
+                queue_current();
+            }
+        }
+        if (current == SIZE_MAX) {
+            // Back-pressure: with every buffer queued the writer waits for the disk
+            std::unique_lock<std::mutex> lock(mutex);
+            buffer_free.wait(lock, [this] { return !free_buffers.empty(); });
+            current = free_buffers.front();
+            free_buffers.pop_front();
+            buffers[current].offset = _Off;
+            buffers[current].size = 0;
+        }
+
+        Buffer& buffer = buffers[current];
+        std::size_t take = std::min(_Count, buffer.data.size() - buffer.size);
+        std::memcpy(buffer.data.data() + buffer.size, _Str, take);
+        buffer.size += take;
+        _Off += take;
+        _Str += take;
+        _Count -= take;
+    }
+}
+
+void split::detail::WriteBehind::queue_current() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(current);
+    }
+    current = SIZE_MAX;
+    work.notify_one();
+}
+
+bool split::detail::WriteBehind::flush() {
+    if (current != SIZE_MAX) {
+        if (buffers[current].size > 0) {
+            queue_current();
+        } else {
+            std::lock_guard<std::mutex> lock(mutex);
+            free_buffers.push_back(current);
+            current = SIZE_MAX;
+        }
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    buffer_free.wait(lock, [this] { return queued.empty() && !writing; });
+    return !error.exchange(false);
+}
+
+void split::detail::WriteBehind::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        work.wait(lock, [this] { return stopping || !queued.empty(); });
+        if (queued.empty()) {
+            return;
+        }
+
+        std::size_t index = queued.front();
+        queued.pop_front();
+        writing = true;
+
+        lock.unlock();
+        Buffer& buffer = buffers[index];
+        if (!sink(buffer.offset, buffer.data.data(), buffer.size)) {
+            error = true;
+        }
+        lock.lock();
+
+        writing = false;
+        free_buffers.push_back(index);
+        // Wakes both a writer waiting for a buffer and flush() waiting for the queue to empty
+        buffer_free.notify_all();
+    }
+}
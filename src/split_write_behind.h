@@ -0,0 +1,70 @@
+#ifndef _SPLIT_WRITE_BEHIND_H_
+#define _SPLIT_WRITE_BEHIND_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+
+#include "split_buffer_pool.h"
+
+namespace split {
+namespace detail {
+
+// Copies writes into a fixed set of large buffers and writes them out on a thread of its own, so the
+// writer only waits when every buffer is still queued. Each buffer holds one contiguous range of the
+// stream, a write anywhere else starts the next one.
+class WriteBehind {
+public:
+    // Writes a buffer at its position in the stream, false on error. Called on the I/O thread.
+    using Sink = std::function<bool(uint64_t _Off, const char* _Str, std::size_t _Count)>;
+
+    WriteBehind(Sink _Sink, std::size_t _Buffer_size, unsigned int _Buffers);
+    WriteBehind(const WriteBehind&) = delete;
+    WriteBehind& operator=(const WriteBehind&) = delete;
+    // Writes out whatever is left
+    ~WriteBehind();
+
+    void write(uint64_t _Off, const char* _Str, std::size_t _Count);
+    // Queues the partly filled buffer and waits until everything has been written. False if a write
+    // failed since the last flush().
+    bool flush();
+    // A write failed and flush() hasn't reported it yet
+    bool failed() const { return error.load(std::memory_order_relaxed); }
+
+private:
+    struct Buffer {
+        PooledBuffer data;
+        uint64_t offset{0};
+        std::size_t size{0};
+    };
+
+    void run();
+    void queue_current();
+
+    Sink sink;
+    std::vector<Buffer> buffers;
+    // Only touched by the writer, the buffer being filled or npos
+    std::size_t current{SIZE_MAX};
+
+    std::mutex mutex;
+    std::condition_variable buffer_free;
+    std::condition_variable work;
+    std::deque<std::size_t> free_buffers;
+    std::deque<std::size_t> queued;
+    // The I/O thread is writing a buffer it has taken off the queue
+    bool writing{false};
+    bool stopping{false};
+    std::atomic<bool> error{false};
+    std::thread worker;
+};
+
+}; // namespace detail
+}; // namespace split
+
+#endif // _SPLIT_WRITE_BEHIND_H_
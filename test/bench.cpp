@@ -0,0 +1,392 @@
+#include <filesystem>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#include <benchmark/benchmark.h>
+
+#include "split_fstream.h"
+
+// Throughput and latency of split::ifstream/split::ofstream against a plain std::fstream over the same data.
+// Reads run against the page cache, drop caches between runs to measure the disk instead.
+//
+// Arguments are { chunk size in bytes, file size in MiB, number of files }, the std::fstream baselines use
+// one file of the same total size.
+
+namespace {
+
+const std::filesystem::path bench_file = "bench_split.bin";
+const std::filesystem::path baseline_file = "bench_baseline.bin";
+const uint64_t MiB = 1024 * 1024;
+// Seeks per iteration in the random and boundary benchmarks
+const int seek_ops = 2000;
+
+void remove_files(const std::vector<std::filesystem::path>& paths) {
+    for (auto& path : paths) {
+        std::filesystem::remove(path);
+    }
+}
+
+std::vector<char> random_buffer(size_t size) {
+    std::vector<char> buffer(size);
+    std::mt19937 gen(1234);
+    for (auto& byte : buffer) {
+        byte = static_cast<char>(gen());
+    }
+    return buffer;
+}
+
+// Per operation latencies, reported as p50/p99 counters in microseconds
+class Latencies {
+public:
+    void start() { begin = std::chrono::steady_clock::now(); }
+    void stop() {
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    void report(benchmark::State& state) {
+        if (samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        state.counters["p50_us"] = samples[samples.size() / 2];
+        state.counters["p99_us"] = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    }
+
+private:
+    std::chrono::steady_clock::time_point begin;
+    std::vector<double> samples;
+};
+
+struct Config {
+    size_t chunk;
+    uint64_t file_size;
+    uint64_t files;
+    uint64_t total() const { return file_size * files; }
+};
+
+Config config(const benchmark::State& state) {
+    return { static_cast<size_t>(state.range(0)), static_cast<uint64_t>(state.range(1)) * MiB, static_cast<uint64_t>(state.range(2)) };
+}
+
+std::vector<std::filesystem::path> make_split(const Config& cfg) {
+    std::vector<char> data = random_buffer(cfg.file_size);
+    split::ofstream fout(bench_file, cfg.file_size);
+    for (uint64_t i = 0; i < cfg.files; ++i) {
+        fout.write(data.data(), data.size());
+    }
+    fout.close();
+    return fout.paths();
+}
+
+void make_baseline(const Config& cfg) {
+    std::vector<char> data = random_buffer(cfg.file_size);
+    std::ofstream fout(baseline_file, std::ios::binary);
+    for (uint64_t i = 0; i < cfg.files; ++i) {
+        fout.write(data.data(), data.size());
+    }
+}
+
+// Offsets for reads/writes of cfg.chunk bytes, either uniformly random or straddling the file boundaries
+std::vector<uint64_t> seek_offsets(const Config& cfg, bool straddle) {
+    std::vector<uint64_t> offsets(seek_ops);
+    std::mt19937_64 gen(99);
+    for (auto& offset : offsets) {
+        if (straddle && cfg.files > 1) {
+            uint64_t boundary = cfg.file_size * (gen() % (cfg.files - 1) + 1);
+            offset = boundary - std::min<uint64_t>(cfg.chunk / 2, boundary);
+        } else {
+            offset = gen() % (cfg.total() - cfg.chunk + 1);
+        }
+    }
+    return offsets;
+}
+
+void set_throughput(benchmark::State& state, uint64_t bytes_per_iteration) {
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes_per_iteration));
+}
+
+// Sequential
+
+void BM_SplitSequentialWrite(benchmark::State& state) {
+    Config cfg = config(state);
+    std::vector<char> chunk = random_buffer(cfg.chunk);
+    Latencies latencies;
+
+    for (auto _ : state) {
+        split::ofstream fout(bench_file, cfg.file_size);
+        for (uint64_t written = 0; written < cfg.total(); written += cfg.chunk) {
+            latencies.start();
+            fout.write(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        fout.close();
+
+        state.PauseTiming();
+        remove_files(fout.paths());
+        state.ResumeTiming();
+    }
+    set_throughput(state, cfg.total());
+    latencies.report(state);
+}
+
+void BM_FstreamSequentialWrite(benchmark::State& state) {
+    Config cfg = config(state);
+    std::vector<char> chunk = random_buffer(cfg.chunk);
+    Latencies latencies;
+
+    for (auto _ : state) {
+        std::ofstream fout(baseline_file, std::ios::binary);
+        for (uint64_t written = 0; written < cfg.total(); written += cfg.chunk) {
+            latencies.start();
+            fout.write(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        fout.close();
+
+        state.PauseTiming();
+        std::filesystem::remove(baseline_file);
+        state.ResumeTiming();
+    }
+    set_throughput(state, cfg.total());
+    latencies.report(state);
+}
+
+void BM_SplitSequentialRead(benchmark::State& state) {
+    Config cfg = config(state);
+    std::vector<std::filesystem::path> paths = make_split(cfg);
+    std::vector<char> chunk(cfg.chunk);
+    Latencies latencies;
+
+    for (auto _ : state) {
+        split::ifstream fin(paths);
+        for (uint64_t read = 0; read < cfg.total(); read += cfg.chunk) {
+            latencies.start();
+            fin.read(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        benchmark::DoNotOptimize(chunk.data());
+    }
+    set_throughput(state, cfg.total());
+    latencies.report(state);
+    remove_files(paths);
+}
+
+void BM_FstreamSequentialRead(benchmark::State& state) {
+    Config cfg = config(state);
+    make_baseline(cfg);
+    std::vector<char> chunk(cfg.chunk);
+    Latencies latencies;
+
+    for (auto _ : state) {
+        std::ifstream fin(baseline_file, std::ios::binary);
+        for (uint64_t read = 0; read < cfg.total(); read += cfg.chunk) {
+            latencies.start();
+            fin.read(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        benchmark::DoNotOptimize(chunk.data());
+    }
+    set_throughput(state, cfg.total());
+    latencies.report(state);
+    std::filesystem::remove(baseline_file);
+}
+
+// Random and boundary straddling, one seek + transfer per operation
+
+void split_seek_reads(benchmark::State& state, bool straddle) {
+    Config cfg = config(state);
+    std::vector<std::filesystem::path> paths = make_split(cfg);
+    std::vector<uint64_t> offsets = seek_offsets(cfg, straddle);
+    std::vector<char> chunk(cfg.chunk);
+    Latencies latencies;
+
+    split::ifstream fin(paths);
+    for (auto _ : state) {
+        for (uint64_t offset : offsets) {
+            latencies.start();
+            fin.seekg(offset, std::ios::beg);
+            fin.read(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        benchmark::DoNotOptimize(chunk.data());
+    }
+    set_throughput(state, seek_ops * cfg.chunk);
+    latencies.report(state);
+    fin.close();
+    remove_files(paths);
+}
+
+void fstream_seek_reads(benchmark::State& state, bool straddle) {
+    Config cfg = config(state);
+    make_baseline(cfg);
+    std::vector<uint64_t> offsets = seek_offsets(cfg, straddle);
+    std::vector<char> chunk(cfg.chunk);
+    Latencies latencies;
+
+    std::ifstream fin(baseline_file, std::ios::binary);
+    for (auto _ : state) {
+        for (uint64_t offset : offsets) {
+            latencies.start();
+            fin.seekg(offset, std::ios::beg);
+            fin.read(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        benchmark::DoNotOptimize(chunk.data());
+    }
+    set_throughput(state, seek_ops * cfg.chunk);
+    latencies.report(state);
+    fin.close();
+    std::filesystem::remove(baseline_file);
+}
+
+void split_seek_writes(benchmark::State& state, bool straddle) {
+    Config cfg = config(state);
+    std::vector<uint64_t> offsets = seek_offsets(cfg, straddle);
+    std::vector<char> chunk = random_buffer(cfg.chunk);
+    std::vector<char> fill = random_buffer(cfg.file_size);
+    Latencies latencies;
+
+    split::ofstream fout(bench_file, cfg.file_size);
+    for (uint64_t i = 0; i < cfg.files; ++i) {
+        fout.write(fill.data(), fill.size());
+    }
+    for (auto _ : state) {
+        for (uint64_t offset : offsets) {
+            latencies.start();
+            fout.seekp(offset, std::ios::beg);
+            fout.write(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+    }
+    set_throughput(state, seek_ops * cfg.chunk);
+    latencies.report(state);
+    fout.close();
+    remove_files(fout.paths());
+}
+
+void fstream_seek_writes(benchmark::State& state, bool straddle) {
+    Config cfg = config(state);
+    std::vector<uint64_t> offsets = seek_offsets(cfg, straddle);
+    std::vector<char> chunk = random_buffer(cfg.chunk);
+    Latencies latencies;
+
+    make_baseline(cfg);
+    std::fstream fout(baseline_file, std::ios::in | std::ios::out | std::ios::binary);
+    for (auto _ : state) {
+        for (uint64_t offset : offsets) {
+            latencies.start();
+            fout.seekp(offset, std::ios::beg);
+            fout.write(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+    }
+    set_throughput(state, seek_ops * cfg.chunk);
+    latencies.report(state);
+    fout.close();
+    std::filesystem::remove(baseline_file);
+}
+
+// The same reads through basic_split_stream, positional reads on descriptors with no iostreams involved
+void basic_seek_reads(benchmark::State& state, bool straddle) {
+    Config cfg = config(state);
+    std::vector<std::filesystem::path> paths = make_split(cfg);
+    std::vector<uint64_t> offsets = seek_offsets(cfg, straddle);
+    std::vector<char> chunk(cfg.chunk);
+    Latencies latencies;
+
+    split::basic_split_stream<split::PosixBackend> fin(paths, split::DynamicSize(cfg.file_size));
+    for (auto _ : state) {
+        for (uint64_t offset : offsets) {
+            latencies.start();
+            fin.seek(offset, std::ios::beg);
+            fin.read(chunk.data(), cfg.chunk);
+            latencies.stop();
+        }
+        benchmark::DoNotOptimize(chunk.data());
+    }
+    set_throughput(state, seek_ops * cfg.chunk);
+    latencies.report(state);
+    fin.close();
+    remove_files(paths);
+}
+
+void BM_SplitRandomRead(benchmark::State& state) { split_seek_reads(state, false); }
+void BM_FstreamRandomRead(benchmark::State& state) { fstream_seek_reads(state, false); }
+void BM_SplitBoundaryRead(benchmark::State& state) { split_seek_reads(state, true); }
+void BM_FstreamBoundaryRead(benchmark::State& state) { fstream_seek_reads(state, true); }
+void BM_BasicRandomRead(benchmark::State& state) { basic_seek_reads(state, false); }
+void BM_BasicBoundaryRead(benchmark::State& state) { basic_seek_reads(state, true); }
+void BM_SplitRandomWrite(benchmark::State& state) { split_seek_writes(state, false); }
+void BM_FstreamRandomWrite(benchmark::State& state) { fstream_seek_writes(state, false); }
+void BM_SplitBoundaryWrite(benchmark::State& state) { split_seek_writes(state, true); }
+void BM_FstreamBoundaryWrite(benchmark::State& state) { fstream_seek_writes(state, true); }
+
+// Many small records through write()/read(), 64 MB per iteration split into 8 MB files
+
+void BM_SmallWrites(benchmark::State& state) {
+    const size_t record_size = static_cast<size_t>(state.range(0));
+    const uint64_t total = 64 * MiB;
+    std::vector<char> record = random_buffer(record_size);
+
+    for (auto _ : state) {
+        split::ofstream fout(bench_file, 8 * MiB);
+        for (uint64_t written = 0; written < total; written += record_size) {
+            fout.write(record.data(), record_size);
+        }
+        fout.close();
+
+        state.PauseTiming();
+        remove_files(fout.paths());
+        state.ResumeTiming();
+    }
+    set_throughput(state, total);
+}
+
+void BM_SmallReads(benchmark::State& state) {
+    const size_t record_size = static_cast<size_t>(state.range(0));
+    const uint64_t total = 64 * MiB;
+    std::vector<std::filesystem::path> paths = make_split({ record_size, 8 * MiB, 8 });
+
+    std::vector<char> record(record_size);
+    for (auto _ : state) {
+        split::ifstream fin(paths);
+        for (uint64_t read = 0; read < total; read += record_size) {
+            fin.read(record.data(), record_size);
+        }
+        benchmark::DoNotOptimize(record.data());
+    }
+    set_throughput(state, total);
+    remove_files(paths);
+}
+
+// { chunk size, file size in MiB, number of files }
+void matrix(benchmark::internal::Benchmark* bench) {
+    bench->ArgNames({ "chunk", "file_mib", "files" });
+    bench->ArgsProduct({ { 4096, 65536, 1024 * 1024 }, { 1, 16 }, { 2, 16 } });
+    bench->Unit(benchmark::kMillisecond);
+}
+
+} // namespace
+
+BENCHMARK(BM_SplitSequentialWrite)->Apply(matrix);
+BENCHMARK(BM_FstreamSequentialWrite)->Apply(matrix);
+BENCHMARK(BM_SplitSequentialRead)->Apply(matrix);
+BENCHMARK(BM_FstreamSequentialRead)->Apply(matrix);
+BENCHMARK(BM_SplitRandomRead)->Apply(matrix);
+BENCHMARK(BM_FstreamRandomRead)->Apply(matrix);
+BENCHMARK(BM_SplitBoundaryRead)->Apply(matrix);
+BENCHMARK(BM_FstreamBoundaryRead)->Apply(matrix);
+BENCHMARK(BM_BasicRandomRead)->Apply(matrix);
+BENCHMARK(BM_BasicBoundaryRead)->Apply(matrix);
+BENCHMARK(BM_SplitRandomWrite)->Apply(matrix);
+BENCHMARK(BM_FstreamRandomWrite)->Apply(matrix);
+BENCHMARK(BM_SplitBoundaryWrite)->Apply(matrix);
+BENCHMARK(BM_FstreamBoundaryWrite)->Apply(matrix);
+
+BENCHMARK(BM_SmallWrites)->Arg(64)->Arg(128)->Arg(256)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SmallReads)->Arg(64)->Arg(128)->Arg(256)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
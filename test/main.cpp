@@ -5,6 +5,14 @@
 #include <sstream>
 #include <iomanip>
 #include <random>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <csignal>
+
+#include <sys/resource.h>
 
 #include "split_fstream.h"
 
@@ -50,6 +58,795 @@ void generate_random_file(const std::filesystem::path& file_path, uint64_t size)
     }
 }
 
+void check_views(split::ifstream& split_fin, const std::filesystem::path& original_path, uint64_t split_size) {
+    std::ifstream fin(original_path, std::ios::binary);
+    if (!fin.is_open()) {
+        throw std::runtime_error("Could not open file: " + original_path.string());
+    }
+
+    // Inside a file, straddling a boundary, exactly on a boundary and running past the end
+    std::vector<uint64_t> offsets = { 0, split_size - 100, split_size, split_size * 5 + 5, split_fin.size() - 10 };
+    std::vector<char> expected(300);
+
+    for (uint64_t offset : offsets) {
+        split::ifstream::View view = split_fin.view(offset, expected.size());
+        uint64_t expected_size = std::min<uint64_t>(expected.size(), split_fin.size() - offset);
+        
+        fin.clear();
+        fin.seekg(offset, std::ios::beg);
+        fin.read(expected.data(), expected_size);
+
+        if (view.size != expected_size || !std::equal(view.begin(), view.end(), expected.begin())) {
+            throw std::runtime_error("View does not match file contents at offset " + std::to_string(offset));
+        }
+    }
+}
+
+std::vector<char> read_whole_file(const std::filesystem::path& file_path) {
+    std::ifstream fin(file_path, std::ios::binary);
+    if (!fin.is_open()) {
+        throw std::runtime_error("Could not open file: " + file_path.string());
+    }
+    std::vector<char> data(std::filesystem::file_size(file_path));
+    fin.read(data.data(), data.size());
+    return data;
+}
+
+void check_positional_io(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+
+    split::WriteOptions write_options;
+    write_options.write_threads = 4;
+    write_options.parallel_chunk = 1024 * 1024;
+    write_options.io_uring = true;
+
+    // Split size deliberately not a multiple of the chunk size
+    split::ofstream split_fout("parallel_split.bin", 1024 * 1024 * 10 + 7, write_options);
+    split_fout.write(data.data(), 1000);
+    split_fout.write(data.data() + 1000, data.size() - 1000);
+    if (split_fout.fail() || split_fout.tellp() != data.size()) {
+        throw std::runtime_error("Failed to write to parallel split file.");
+    }
+
+    // Overwrite a range straddling the first boundary without moving the write position
+    split_fout.flush();
+    std::vector<char> patch(200, 'x');
+    std::copy(patch.begin(), patch.end(), data.begin() + 1024 * 1024 * 10 + 7 - 100);
+    if (split_fout.write_at(1024 * 1024 * 10 + 7 - 100, patch.data(), patch.size()) != patch.size() || split_fout.tellp() != data.size()) {
+        throw std::runtime_error("Failed to write_at to parallel split file.");
+    }
+
+    // Header, payload and trailer in one vectored write, the payload crosses a boundary
+    std::vector<char> header(16, 'h'), trailer(16, 't');
+    std::vector<split::IoVec> parts = {
+        { header.data(), header.size() },
+        { data.data(), 1024 * 1024 * 11 },
+        { trailer.data(), trailer.size() }
+    };
+    std::vector<char> appended(header);
+    appended.insert(appended.end(), data.begin(), data.begin() + 1024 * 1024 * 11);
+    appended.insert(appended.end(), trailer.begin(), trailer.end());
+    split_fout.writev(parts.data(), parts.size());
+    data.insert(data.end(), appended.begin(), appended.end());
+    if (split_fout.fail() || split_fout.tellp() != data.size()) {
+        throw std::runtime_error("Failed to writev to parallel split file.");
+    }
+
+    // A batch of patches in flight at once, one of them over the second boundary
+    split_fout.flush();
+    std::vector<char> batch_data(3000, 'b');
+    std::vector<split::IoRequest> writes = {
+        { 5, batch_data.data(), 1000 },
+        { (1024 * 1024 * 10 + 7) * 2 - 500, batch_data.data() + 1000, 1000 },
+        { data.size() - 1000, batch_data.data() + 2000, 1000 }
+    };
+    for (auto& request : writes) {
+        std::fill(data.begin() + request.offset, data.begin() + request.offset + request.size, 'b');
+    }
+    if (split_fout.write_batch(writes.data(), writes.size()) != writes.size() || writes[1].transferred != 1000) {
+        throw std::runtime_error("Failed to write_batch to parallel split file.");
+    }
+    split_fout.close();
+
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    {
+        split::ifstream split_fin(split_files);
+        std::vector<char> read_back(split_fin.size());
+        split_fin.read(read_back.data(), read_back.size());
+        if (split_fin.gcount() != data.size() || read_back != data) {
+            throw std::runtime_error("Parallel split file does not match the original.");
+        }
+
+        // Scatter a range straddling a boundary over several buffers
+        std::vector<char> first(3), second(5000), third(100);
+        std::vector<split::IoVec> parts = {
+            { first.data(), first.size() },
+            { second.data(), second.size() },
+            { third.data(), third.size() }
+        };
+        uint64_t offset = 1024 * 1024 * 10 + 7 - 1000;
+        split_fin.seekg(offset, std::ios::beg);
+        split_fin.readv(parts.data(), parts.size());
+        std::vector<char> scattered(first);
+        scattered.insert(scattered.end(), second.begin(), second.end());
+        scattered.insert(scattered.end(), third.begin(), third.end());
+        if (split_fin.gcount() != scattered.size() || split_fin.tellg() != offset + scattered.size() ||
+            !std::equal(scattered.begin(), scattered.end(), data.begin() + offset)) {
+            throw std::runtime_error("readv does not match the original.");
+        }
+
+        // Several threads sharing the stream through read_at
+        std::vector<std::thread> readers;
+        std::atomic<bool> mismatch{false};
+        for (unsigned int t = 0; t < 4; ++t) {
+            readers.emplace_back([&, t] {
+                std::mt19937_64 gen(t);
+                std::vector<char> buffer(100000);
+                for (int i = 0; i < 200; ++i) {
+                    uint64_t offset = gen() % data.size();
+                    uint64_t got = split_fin.read_at(offset, buffer.data(), buffer.size());
+                    if (got != std::min<uint64_t>(buffer.size(), data.size() - offset) ||
+                        !std::equal(buffer.begin(), buffer.begin() + got, data.begin() + offset)) {
+                        mismatch = true;
+                    }
+                }
+            });
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        if (mismatch) {
+            throw std::runtime_error("read_at does not match the original.");
+        }
+    }
+
+    // Two streams sharing a cache too small for the data, so blocks get evicted along the way
+    {
+        split::ReadOptions read_options;
+        read_options.block_cache = std::make_shared<split::BlockCache>(1024 * 1024, 16 * 1024, 4);
+        split::ifstream first(split_files, read_options);
+        split::ifstream second(split_files, read_options);
+        std::mt19937_64 gen(11);
+        std::vector<char> buffer(50000);
+        for (int i = 0; i < 2000; ++i) {
+            // Hot region across the first boundary, the rest anywhere
+            uint64_t offset = (i % 4 == 0) ? gen() % data.size() : 1024 * 1024 * 10 - 20000 + gen() % 40000;
+            uint64_t got;
+            if (i % 2 == 0) {
+                first.clear();
+                first.seekg(offset, std::ios::beg);
+                first.read(buffer.data(), buffer.size());
+                got = first.gcount();
+            } else {
+                got = second.read_at(offset, buffer.data(), buffer.size());
+            }
+            if (got != std::min<uint64_t>(buffer.size(), data.size() - offset) ||
+                !std::equal(buffer.begin(), buffer.begin() + got, data.begin() + offset)) {
+                throw std::runtime_error("Cached reads do not match the original.");
+            }
+        }
+        if (read_options.block_cache->hits() == 0) {
+            throw std::runtime_error("Cached reads never hit the cache.");
+        }
+    }
+
+    // Batches of random reads through io_uring and without it, the last request runs past the end
+    for (bool io_uring : { true, false }) {
+        split::ReadOptions read_options;
+        read_options.io_uring = io_uring;
+        read_options.io_depth = 8;
+        split::ifstream split_fin(split_files, read_options);
+        std::mt19937_64 gen(7);
+        std::vector<std::vector<char>> buffers(100, std::vector<char>(200000));
+        std::vector<split::IoRequest> reads;
+        for (auto& buffer : buffers) {
+            reads.push_back({ gen() % (data.size() - buffer.size()), buffer.data(), buffer.size() });
+        }
+        reads.back().offset = data.size() - 1000;
+        if (split_fin.read_batch(reads.data(), reads.size()) != reads.size() - 1 || reads.back().transferred != 1000) {
+            throw std::runtime_error("read_batch came back short.");
+        }
+        for (std::size_t i = 0; i < reads.size(); ++i) {
+            if (!std::equal(buffers[i].begin(), buffers[i].begin() + reads[i].transferred, data.begin() + reads[i].offset)) {
+                throw std::runtime_error("read_batch does not match the original.");
+            }
+        }
+    }
+
+    // The whole stream read ahead on several threads, taken in odd sized pieces, then again after a seek
+    {
+        split::ReadOptions read_options;
+        read_options.read_threads = 4;
+        read_options.read_chunk = 1024 * 1024 * 3;
+        split::ifstream split_fin(split_files, read_options);
+        std::vector<char> read_back(split_fin.size());
+        uint64_t done = 0;
+        while (done < read_back.size()) {
+            split_fin.read(read_back.data() + done, std::min<uint64_t>(777777, read_back.size() - done));
+            if (split_fin.gcount() == 0) {
+                break;
+            }
+            done += split_fin.gcount();
+        }
+        if (split_fin.fail() || read_back != data) {
+            throw std::runtime_error("Reading ahead does not match the original.");
+        }
+
+        uint64_t offset = 1024 * 1024 * 10 + 7 - 1000;
+        std::vector<char> chunk(1024 * 1024 * 5);
+        split_fin.seekg(offset, std::ios::beg);
+        split_fin.read(chunk.data(), chunk.size());
+        if (split_fin.gcount() != chunk.size() || split_fin.tellg() != offset + chunk.size() ||
+            !std::equal(chunk.begin(), chunk.end(), data.begin() + offset)) {
+            throw std::runtime_error("Reading ahead after a seek does not match the original.");
+        }
+
+        // Stopping partway, the threads sleep until the reader takes more instead of polling
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        std::clock_t cpu_before = std::clock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        if (std::clock() - cpu_before > CLOCKS_PER_SEC / 50) {
+            throw std::runtime_error("Read ahead threads keep running while the reader is paused.");
+        }
+    }
+
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_direct_write(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+
+    split::WriteOptions write_options;
+    write_options.direct_io = true;
+    write_options.buffer_size = 1024 * 1024;
+    write_options.manifest = true;
+
+    // Odd write sizes and a split size that isn't page aligned, so every file has unaligned edges
+    split::ofstream split_fout("direct_split.bin", 1024 * 1024 * 10 + 7, write_options);
+    std::mt19937 gen(42);
+    uint64_t written = 0;
+    while (written < data.size()) {
+        uint64_t chunk = std::min<uint64_t>(gen() % 300000 + 1, data.size() - written);
+        split_fout.write(data.data() + written, chunk);
+        written += chunk;
+    }
+
+    // Go back and overwrite a range across the first boundary
+    std::vector<char> patch(5000, 'd');
+    std::copy(patch.begin(), patch.end(), data.begin() + 1024 * 1024 * 10);
+    split_fout.seekp(1024 * 1024 * 10, std::ios::beg);
+    split_fout.write(patch.data(), patch.size());
+    split_fout.seekp(0, std::ios::end);
+    if (split_fout.fail() || split_fout.tellp() != data.size()) {
+        throw std::runtime_error("Failed to write to direct split file.");
+    }
+    split_fout.close();
+
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    {
+        // No checksums were asked for, the manifest still has the sizes
+        split::Manifest manifest = split::Manifest::load("direct_split.bin.manifest");
+        if (manifest.has_checksums || manifest.paths().size() != split_files.size() || manifest.total_size() != data.size()) {
+            throw std::runtime_error("Direct split manifest does not match the files.");
+        }
+        split::ifstream split_fin(manifest);
+        std::vector<char> read_back(split_fin.size());
+        split_fin.read(read_back.data(), read_back.size());
+        if (read_back != data) {
+            throw std::runtime_error("Direct split file does not match the original.");
+        }
+    }
+
+    split_files.push_back("direct_split.bin.manifest");
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_checksums(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+    if (split::detail::crc32c(0, "123456789", 9) != 0xE3069283) {
+        throw std::runtime_error("CRC-32C check value is wrong.");
+    }
+
+    // Mix streamed and parallel writes, the parallel pieces are checksummed on their own and chained
+    split::WriteOptions write_options;
+    write_options.checksums = true;
+    write_options.manifest = true;
+    write_options.write_threads = 4;
+    write_options.parallel_chunk = 1024 * 1024;
+
+    std::vector<std::filesystem::path> split_files;
+    {
+        split::ofstream split_fout("checksum_split.bin", 1024 * 1024 * 10, write_options);
+        split_fout.write(data.data(), 12345);
+        split_fout.write(data.data() + 12345, 1024 * 1024 * 30);
+        split_fout.write(data.data() + 12345 + 1024 * 1024 * 30, data.size() - 12345 - 1024 * 1024 * 30);
+        split_fout.close();
+        split_files = split_fout.paths();
+    }
+
+    std::vector<split::detail::ChecksumEntry> entries;
+    if (!split::detail::read_checksum_file("checksum_split.bin.crc32c", entries) || entries.size() != split_files.size() + 1 ||
+        entries[0].crc != split::detail::crc32c(0, data.data(), data.size())) {
+        throw std::runtime_error("Checksum file does not match the data.");
+    }
+
+    split::ReadOptions read_options;
+    read_options.checksum_file = "checksum_split.bin.crc32c";
+    read_options.max_open_streams = 2;
+    std::vector<char> read_back(data.size());
+    {
+        split::ifstream split_fin(split_files, read_options);
+        split_fin.read(read_back.data(), read_back.size());
+        if (!split_fin.good() || read_back != data) {
+            throw std::runtime_error("Verified read failed.");
+        }
+    }
+
+    // The manifest alone is enough to open the files, and carries the same checksums
+    {
+        split::Manifest manifest = split::Manifest::load("checksum_split.bin.manifest");
+        if (!manifest.has_checksums || manifest.total_size() != data.size() || manifest.segments.size() != split_files.size()) {
+            throw std::runtime_error("Manifest does not match the files.");
+        }
+        split::ReadOptions manifest_options;
+        manifest_options.verify_manifest = true;
+        split::ifstream split_fin(manifest, manifest_options);
+        std::fill(read_back.begin(), read_back.end(), 0);
+        split_fin.read(read_back.data(), read_back.size());
+        if (!split_fin.good() || read_back != data) {
+            throw std::runtime_error("Read through the manifest failed.");
+        }
+    }
+
+    // Flip a byte in the middle of the third file, reading through it has to fail
+    {
+        std::fstream corrupt(split_files[2], std::ios::in | std::ios::out | std::ios::binary);
+        corrupt.seekp(4096);
+        corrupt.put(static_cast<char>(~data[1024 * 1024 * 20 + 4096]));
+    }
+    {
+        split::ifstream split_fin(split_files, read_options);
+        std::vector<split::IoVec> parts = {
+            { read_back.data(), 1024 * 1024 * 15 },
+            { read_back.data() + 1024 * 1024 * 15, read_back.size() - 1024 * 1024 * 15 }
+        };
+        split_fin.readv(parts.data(), parts.size());
+        if (!split_fin.fail()) {
+            throw std::runtime_error("Corrupted file was not detected.");
+        }
+    }
+
+    // Files can't grow past 512 KiB while writing, the buffered writes of the first two files fail and
+    // no checksums may be left for them
+    {
+        rlimit old_limit;
+        ::getrlimit(RLIMIT_FSIZE, &old_limit);
+        rlimit limit = old_limit;
+        limit.rlim_cur = 512 * 1024;
+        std::signal(SIGXFSZ, SIG_IGN);
+        ::setrlimit(RLIMIT_FSIZE, &limit);
+        split::WriteOptions failing_options;
+        failing_options.checksums = true;
+        failing_options.manifest = true;
+        split::ofstream split_fout("failing_split.bin", 1024 * 1024, failing_options);
+        split_fout.write(data.data(), 1024 * 1024 * 3);
+        ::setrlimit(RLIMIT_FSIZE, &old_limit);
+        std::signal(SIGXFSZ, SIG_DFL);
+        split_fout.close();
+
+        bool sidecar = std::filesystem::exists("failing_split.bin.crc32c");
+        bool manifest_checksums = split::Manifest::load("failing_split.bin.manifest").has_checksums;
+        std::vector<std::filesystem::path> failing_files = split_fout.paths();
+        for (auto& file : failing_files) {
+            std::filesystem::remove(file);
+        }
+        std::filesystem::remove("failing_split.bin.crc32c");
+        std::filesystem::remove("failing_split.bin.manifest");
+        if (!split_fout.fail() || sidecar || manifest_checksums) {
+            throw std::runtime_error("Checksums were written for data that never reached the files.");
+        }
+    }
+
+    split_files.push_back("checksum_split.bin.crc32c");
+    split_files.push_back("checksum_split.bin.manifest");
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_naming(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(1024 * 1024 * 12);
+
+    // 12 files of 1 MiB, known up front, so they get their padded names straight away
+    split::WriteOptions write_options;
+    write_options.expected_size = data.size();
+    split::ofstream split_fout("named_split.bin", 1024 * 1024, write_options);
+    split_fout.write(data.data(), data.size());
+    std::vector<std::filesystem::path> before_close = split_fout.paths();
+    split_fout.close();
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    if (before_close != split_files || split_files[0].filename() != "named_split.01.bin") {
+        throw std::runtime_error("Files were renamed even though the size was known.");
+    }
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+
+    // Nothing shows up under the final names until close()
+    write_options = split::WriteOptions();
+    write_options.publish_on_close = true;
+    write_options.manifest = true;
+    split_fout.open("published_split.bin", 1024 * 1024 * 5, write_options);
+    split_fout.write(data.data(), data.size());
+    split_fout.flush();
+    if (std::filesystem::exists("published_split.1.bin") || std::filesystem::exists("published_split.bin.manifest")) {
+        throw std::runtime_error("Files were published before close().");
+    }
+    split_fout.close();
+
+    split::ifstream split_fin(split::Manifest::load("published_split.bin.manifest"));
+    std::vector<char> read_back(split_fin.size());
+    split_fin.read(read_back.data(), read_back.size());
+    if (read_back != data || !std::filesystem::exists("published_split.3.bin")) {
+        throw std::runtime_error("Published files do not match the original.");
+    }
+    split_fin.close();
+
+    split_files = split_fout.paths();
+    split_files.push_back("published_split.bin.manifest");
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_compression(const std::filesystem::path& original_path) {
+    // Random data doesn't compress, so half of it is replaced with text that does
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(1024 * 1024 * 8 + 12345);
+    std::string line = "split::ofstream writes compressed frames\n";
+    for (std::size_t i = data.size() / 2; i < data.size(); ++i) {
+        data[i] = line[i % line.size()];
+    }
+
+    split::WriteOptions write_options;
+    write_options.compression = split::Compression::lz4;
+    write_options.frame_size = 256 * 1024;
+    split::ofstream split_fout("compressed_split.bin", 1024 * 1024, write_options);
+    split_fout.write(data.data(), 1000);
+    split_fout.write(data.data() + 1000, data.size() - 1000);
+    split_fout.close();
+
+    split::ifstream split_fin(split::Manifest::load("compressed_split.bin.manifest"));
+    std::vector<char> read_back(split_fin.size());
+    split_fin.read(read_back.data(), read_back.size());
+    if (read_back != data) {
+        throw std::runtime_error("Compressed stream does not match the original.");
+    }
+
+    // Reads in the middle of a frame, across frames and at the end
+    uint64_t offset = data.size() / 2 - 100000;
+    std::vector<char> chunk(700000);
+    split_fin.clear();
+    split_fin.seekg(offset, std::ios::beg);
+    split_fin.read(chunk.data(), chunk.size());
+    if (split_fin.gcount() != chunk.size() || !std::equal(chunk.begin(), chunk.end(), data.begin() + offset)) {
+        throw std::runtime_error("Seeking in a compressed stream failed.");
+    }
+    uint64_t tail = split_fin.read_at(data.size() - 100, chunk.data(), chunk.size());
+    if (tail != 100 || !std::equal(chunk.begin(), chunk.begin() + 100, data.end() - 100)) {
+        throw std::runtime_error("read_at in a compressed stream failed.");
+    }
+    split::join(split_fin, "compressed_joined.bin");
+    if (read_whole_file("compressed_joined.bin") != data) {
+        throw std::runtime_error("Joined compressed stream does not match the original.");
+    }
+    std::filesystem::remove("compressed_joined.bin");
+    split_fin.close();
+
+    // Frames decompressed on several threads ahead of the reader
+    split::ReadOptions read_options;
+    read_options.read_threads = 3;
+    split_fin.open(split::Manifest::load("compressed_split.bin.manifest"), read_options);
+    std::fill(read_back.begin(), read_back.end(), 0);
+    split_fin.read(read_back.data(), read_back.size());
+    if (split_fin.fail() || read_back != data) {
+        throw std::runtime_error("Compressed stream read ahead does not match the original.");
+    }
+    split_fin.close();
+
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    uint64_t stored = 0;
+    for (auto& file : split_files) {
+        stored += std::filesystem::file_size(file);
+    }
+    if (stored >= data.size() * 3 / 4) {
+        throw std::runtime_error("Compressed stream didn't get smaller.");
+    }
+    split_files.push_back("compressed_split.bin.manifest");
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_write_behind(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(1024 * 1024 * 8);
+
+    // Small buffers so the writer has to wait for them, and the data ends right on a file boundary
+    split::WriteOptions write_options;
+    write_options.write_behind = true;
+    write_options.buffer_size = 256 * 1024;
+    write_options.write_behind_buffers = 3;
+    write_options.checksums = true;
+    write_options.manifest = true;
+    split::ofstream split_fout("behind_split.bin", 1024 * 1024, write_options);
+    std::size_t written = 0;
+    for (std::size_t piece = 1; written < data.size(); piece = piece * 3 % 1000003) {
+        std::size_t size = std::min(piece, data.size() - written);
+        split_fout.write(data.data() + written, size);
+        written += size;
+    }
+    split_fout.flush();
+    if (split_fout.fail() || std::filesystem::file_size("behind_split.1.bin") != 1024 * 1024) {
+        throw std::runtime_error("flush() didn't wait for the write-behind thread.");
+    }
+    split_fout.close();
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    if (split_fout.fail() || split_files.size() != 8 || std::filesystem::exists("behind_split.9.bin")) {
+        throw std::runtime_error("Write-behind left the wrong files.");
+    }
+
+    split::ReadOptions read_options;
+    read_options.verify_manifest = true;
+    split::ifstream split_fin(split::Manifest::load("behind_split.bin.manifest"), read_options);
+    std::vector<char> read_back(split_fin.size());
+    split_fin.read(read_back.data(), read_back.size());
+    if (split_fin.fail() || read_back != data) {
+        throw std::runtime_error("Write-behind files do not match the original.");
+    }
+    split_fin.close();
+
+    split_files.push_back("behind_split.bin.manifest");
+    split_files.push_back("behind_split.bin.crc32c");
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+
+    // The end is where the data ends, with the position asked for between writes
+    split::WriteOptions end_options;
+    end_options.write_behind = true;
+    end_options.buffer_size = 64 * 1024;
+    split::ofstream end_fout("behind_end.bin", 1024 * 1024, end_options);
+    for (std::size_t written = 0; written < 1536000; written += 12000) {
+        end_fout.write(data.data() + written, 12000);
+        end_fout.seekp(0, std::ios::cur);
+    }
+    end_fout.seekp(0, std::ios::end);
+    if (end_fout.tellp() != 1536000) {
+        throw std::runtime_error("seekp() to the end of a write-behind stream went to the wrong place.");
+    }
+    end_fout.close();
+    for (auto& file : std::vector<std::filesystem::path>(end_fout.paths())) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_preallocation(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(100 * 1024);
+
+    // The seek skips the rest of the first file and all of the second
+    split::WriteOptions write_options;
+    write_options.preallocate = true;
+    split::ofstream split_fout("prealloc_split.bin", 1024 * 1024, write_options);
+    split_fout.write(data.data(), data.size());
+    split_fout.seekp(2 * 1024 * 1024 + 512 * 1024, std::ios::beg);
+    split_fout.write(data.data(), data.size());
+    split_fout.close();
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    if (split_fout.fail() || split_files.size() != 3
+        || std::filesystem::file_size(split_files[0]) != 1024 * 1024
+        || std::filesystem::file_size(split_files[1]) != 1024 * 1024
+        || std::filesystem::file_size(split_files[2]) != 512 * 1024 + data.size()) {
+        throw std::runtime_error("Preallocated files have the wrong sizes.");
+    }
+
+    std::vector<char> expected(2 * 1024 * 1024 + 512 * 1024 + data.size(), 0);
+    std::copy(data.begin(), data.end(), expected.begin());
+    std::copy(data.begin(), data.end(), expected.end() - data.size());
+    std::vector<char> read_back;
+    for (auto& file : split_files) {
+        std::vector<char> part = read_whole_file(file);
+        read_back.insert(read_back.end(), part.begin(), part.end());
+    }
+    if (read_back != expected) {
+        throw std::runtime_error("Skipped parts of preallocated files do not read as zeros.");
+    }
+
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+void check_kernel_copy(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(1024 * 1024 * 10 + 123);
+    {
+        std::ofstream source("copy_source.bin", std::ios::binary);
+        source.write(data.data(), data.size());
+    }
+
+    // Files that don't start at a file boundary of the source, copied on several threads
+    std::vector<std::filesystem::path> split_files = split::split_file("copy_source.bin", "copy_split.bin", 1024 * 1024 * 3 + 7, split::WriteOptions(), 3);
+    if (split_files.size() != 4 || std::filesystem::file_size(split_files[3]) != data.size() - 3 * (1024 * 1024 * 3 + 7)) {
+        throw std::runtime_error("split_file() made the wrong files.");
+    }
+
+    split::ifstream split_fin;
+    split_fin.open_split("copy_split.bin");
+    if (split::join(split_fin, "copy_joined.bin", 3) != data.size() || read_whole_file("copy_joined.bin") != data) {
+        throw std::runtime_error("Joined file does not match the original.");
+    }
+    split_fin.close();
+
+    // Buffered writes on either side of the copy land where they belong
+    split::ofstream split_fout("copy_mixed.bin", 1024 * 1024 * 4);
+    split_fout.write(data.data(), 1000);
+    split_fout.write_file("copy_source.bin");
+    split_fout.write(data.data(), 1000);
+    split_fout.close();
+    std::vector<std::filesystem::path> mixed_files = split_fout.paths();
+    std::vector<char> expected(data.begin(), data.begin() + 1000);
+    expected.insert(expected.end(), data.begin(), data.end());
+    expected.insert(expected.end(), data.begin(), data.begin() + 1000);
+    std::vector<char> read_back;
+    for (auto& file : mixed_files) {
+        std::vector<char> part = read_whole_file(file);
+        read_back.insert(read_back.end(), part.begin(), part.end());
+    }
+    if (split_fout.fail() || read_back != expected) {
+        throw std::runtime_error("write_file() does not line up with write().");
+    }
+
+    split_files.insert(split_files.end(), mixed_files.begin(), mixed_files.end());
+    split_files.push_back("copy_source.bin");
+    split_files.push_back("copy_joined.bin");
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
+template <typename Backend, typename SizePolicy>
+void check_basic_stream_backend(const std::vector<char>& data, SizePolicy sizes, SizePolicy read_sizes) {
+    // The mapping is read-only, those files are written through file descriptors
+    using Writer = std::conditional_t<std::is_same_v<Backend, split::MmapBackend>, split::PosixBackend, Backend>;
+    constexpr bool in_memory = std::is_same_v<Backend, split::MemoryBackend>;
+
+    // Pieces that don't line up with the files, then a jump that skips a whole file
+    split::basic_split_stream<Writer, SizePolicy> split_fout("basic_split.bin", sizes);
+    std::size_t written = 0;
+    for (std::size_t piece = 1; written < data.size(); piece = piece * 7 % 100003) {
+        std::size_t size = std::min(piece, data.size() - written);
+        split_fout.write(data.data() + written, size);
+        written += size;
+    }
+    uint64_t gap = sizes.segment_size() * 2;
+    split_fout.seek(gap, std::ios::cur);
+    split_fout.write(data.data(), 1000);
+    split_fout.close();
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+    if (split_fout.fail() || split_files.size() != (data.size() + gap + 1000 - 1) / sizes.segment_size() + 1) {
+        throw std::runtime_error("basic_split_stream wrote the wrong files.");
+    }
+
+    std::vector<char> expected(data);
+    expected.resize(data.size() + gap);
+    expected.insert(expected.end(), data.begin(), data.begin() + 1000);
+    split::basic_split_stream<Backend, SizePolicy> split_fin(split_files, read_sizes);
+    std::vector<char> read_back(split_fin.size());
+    split_fin.read(read_back.data(), read_back.size());
+    if (split_fin.fail() || split_fin.segment_size() != sizes.segment_size() || read_back != expected) {
+        throw std::runtime_error("basic_split_stream files do not match the original.");
+    }
+
+    uint64_t offset = sizes.segment_size() - 10;
+    std::vector<char> chunk(20);
+    if (split_fin.read_at(offset, chunk.data(), chunk.size()) != chunk.size() || !std::equal(chunk.begin(), chunk.end(), expected.begin() + offset)) {
+        throw std::runtime_error("basic_split_stream read across a file boundary failed.");
+    }
+    split_fin.seek(10, std::ios::end);
+    split_fin.seek(-20, std::ios::cur);
+    split_fin.read(chunk.data(), chunk.size());
+    if (!split_fin.eof() || split_fin.gcount() != 10 || !std::equal(chunk.begin(), chunk.begin() + 10, expected.end() - 10)) {
+        throw std::runtime_error("basic_split_stream read past the end failed.");
+    }
+    split_fin.close();
+
+    for (auto& file : split_files) {
+        if (in_memory) {
+            split::MemoryBackend::remove(file);
+        } else {
+            std::filesystem::remove(file);
+        }
+    }
+}
+
+void check_basic_stream(const std::filesystem::path& original_path) {
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(1024 * 1024 + 5);
+
+    check_basic_stream_backend<split::PosixBackend>(data, split::FixedSize<64 * 1024>(), split::FixedSize<64 * 1024>());
+    check_basic_stream_backend<split::MmapBackend>(data, split::FixedSize<64 * 1024>(), split::FixedSize<64 * 1024>());
+    check_basic_stream_backend<split::FstreamBackend>(data, split::FixedSize<64 * 1024>(), split::FixedSize<64 * 1024>());
+    check_basic_stream_backend<split::MemoryBackend>(data, split::FixedSize<64 * 1024>(), split::FixedSize<64 * 1024>());
+    // Read back without being told the size, it's taken from the first file
+    check_basic_stream_backend<split::PosixBackend>(data, split::DynamicSize(100003), split::DynamicSize());
+    check_basic_stream_backend<split::FstreamBackend>(data, split::DynamicSize(100003), split::DynamicSize());
+    check_basic_stream_backend<split::MemoryBackend>(data, split::DynamicSize(100003), split::DynamicSize());
+    if (split::MemoryBackend::exists("basic_split.1.bin")) {
+        throw std::runtime_error("MemoryBackend kept a removed file.");
+    }
+}
+
+std::size_t open_descriptors() {
+    std::size_t count = 0;
+    for (auto& entry : std::filesystem::directory_iterator("/proc/self/fd")) {
+        (void)entry;
+        ++count;
+    }
+    return count;
+}
+
+void check_open_limit(const std::filesystem::path& original_path) {
+    if (!std::filesystem::exists("/proc/self/fd")) {
+        return;
+    }
+    std::vector<char> data = read_whole_file(original_path);
+    data.resize(40 * 64 * 1024);
+    split::ofstream split_fout("limit_split.bin", 64 * 1024);
+    split_fout.write(data.data(), data.size());
+    split_fout.close();
+    std::vector<std::filesystem::path> split_files = split_fout.paths();
+
+    // Positional reads and prefetching take their descriptors from the same limit as the streams
+    std::size_t before = open_descriptors();
+    {
+        split::ReadOptions read_options;
+        read_options.max_open_streams = 2;
+        read_options.prefetch_bytes = 256 * 1024;
+        split::ifstream split_fin(split_files, read_options);
+        std::vector<char> chunk(1000);
+        std::vector<split::IoRequest> requests;
+        for (uint64_t offset = 32 * 1024; offset < data.size(); offset += 64 * 1024) {
+            if (split_fin.read_at(offset, chunk.data(), chunk.size()) != chunk.size() || !std::equal(chunk.begin(), chunk.end(), data.begin() + offset)) {
+                throw std::runtime_error("read_at() with a limit on open files failed.");
+            }
+            requests.push_back({ offset, chunk.data(), chunk.size() });
+        }
+        if (split_fin.read_batch(requests.data(), 2) != 2 || open_descriptors() > before + 4) {
+            throw std::runtime_error("Positional reads went over the limit on open files.");
+        }
+        std::vector<char> read_back(data.size());
+        for (uint64_t done = 0; done < read_back.size(); done += 16 * 1024) {
+            split_fin.read(read_back.data() + done, 16 * 1024);
+        }
+        // Gives the prefetch thread time to get to the last file
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (read_back != data || open_descriptors() > before + 4) {
+            throw std::runtime_error("Prefetching went over the limit on open files.");
+        }
+    }
+
+    for (auto& file : split_files) {
+        std::filesystem::remove(file);
+    }
+}
+
 int main() {
     std::filesystem::path random_file = "random.bin";
     generate_random_file(random_file, 1024 * 1024 * 100); // 100 MB
@@ -61,7 +858,10 @@ int main() {
         throw std::runtime_error("Could not open file: " + random_file.string());
     }
     
-    split::ofstream split_fout("random_split.bin", 1024 * 1024 * 10); // 10 MB
+    split::WriteOptions write_options;
+    write_options.buffer_size = 1024 * 1024;
+
+    split::ofstream split_fout("random_split.bin", 1024 * 1024 * 10, write_options); // 10 MB
     if (!split_fout.is_open()) {
         throw std::runtime_error("Could not open split file.");
     }
@@ -100,7 +900,38 @@ int main() {
 
     std::vector<std::filesystem::path> split_files = split_fout.paths();
 
-    split::ifstream split_fin(split_files);
+    // The files can be found again from the name they were written under
+    {
+        split::ifstream found;
+        found.open_split("random_split.bin");
+        if (found.size() != fin_size) {
+            throw std::runtime_error("open_split() did not find the split files.");
+        }
+    }
+    {
+        std::ofstream("gap.1.bin").put('a');
+        std::ofstream("gap.3.bin").put('c');
+        bool threw = false;
+        try {
+            split::ifstream gap;
+            gap.open_split("gap.bin");
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        std::filesystem::remove("gap.1.bin");
+        std::filesystem::remove("gap.3.bin");
+        if (!threw) {
+            throw std::runtime_error("open_split() did not notice a missing file.");
+        }
+    }
+
+    // Keep fewer files open than there are segments so the reads exercise reopening them
+    split::ReadOptions read_options;
+    read_options.max_open_streams = 2;
+    read_options.prefetch_bytes = 1024 * 1024 * 4;
+    read_options.buffer_size = 1024 * 256;
+
+    split::ifstream split_fin(split_files, read_options);
     if (!split_fin.is_open()) {
         throw std::runtime_error("Could not open split file.");
     }
@@ -144,6 +975,30 @@ int main() {
         print_progress(bytes_left, fin_size);
     }
 
+#if SPLIT_FSTREAM_STATS
+    // Every byte went through read() exactly once, and each file had to be opened at least once
+    split::IoStats read_stats = split_fin.stats();
+    if (read_stats.bytes != fin_size || read_stats.segment_opens < split_files.size()) {
+        throw std::runtime_error("Read statistics do not match.");
+    }
+#endif
+
+    std::cerr << "Checking views..." << std::endl;
+    check_views(split_fin, random_file, 1024 * 1024 * 10);
+
+    std::cerr << "Hashing files..." << std::endl;
+    split::Sha256 sha256;
+    sha256.update("abc", 3);
+    if (split::Sha256::to_hex(sha256.finish()) != "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") {
+        throw std::runtime_error("SHA-256 test vector does not match.");
+    }
+    std::vector<split::Sha256::Digest> digests = split_fin.segment_digests(4);
+    for (size_t i = 0; i < split_files.size(); i++) {
+        if (digests[i] != split::sha256_file(split_files[i])) {
+            throw std::runtime_error("Parallel file digests do not match.");
+        }
+    }
+
     split_fin.close();
     fout.close();
 
@@ -155,6 +1010,36 @@ int main() {
         throw std::runtime_error("Files have different checksums.");
     }
 
+    std::cerr << "Checking parallel and positional I/O..." << std::endl;
+    check_positional_io(random_file);
+
+    std::cerr << "Checking direct I/O..." << std::endl;
+    check_direct_write(random_file);
+
+    std::cerr << "Checking checksums..." << std::endl;
+    check_checksums(random_file);
+
+    std::cerr << "Checking file naming..." << std::endl;
+    check_naming(random_file);
+
+    std::cerr << "Checking write-behind..." << std::endl;
+    check_write_behind(random_file);
+
+    std::cerr << "Checking preallocation..." << std::endl;
+    check_preallocation(random_file);
+
+    std::cerr << "Checking kernel copies..." << std::endl;
+    check_kernel_copy(random_file);
+
+    std::cerr << "Checking basic_split_stream..." << std::endl;
+    check_basic_stream(random_file);
+
+    std::cerr << "Checking the limit on open files..." << std::endl;
+    check_open_limit(random_file);
+
+    std::cerr << "Checking compression..." << std::endl;
+    check_compression(random_file);
+
     std::cerr << "Cleaning up..." << std::endl;
     split_files.push_back(random_file_recon);
     split_files.push_back(random_file);